@@ -0,0 +1,221 @@
+/*
+ * SHA-1 using the ARMv8 Crypto Extensions
+ *
+ * Based on sha1_glue.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/internal.h>
+#include <asm/byteorder.h>
+#include <asm/system.h>
+
+typedef u32 u32x4 __attribute__((vector_size(16)));
+
+static const u32x4 sha1_k[4] = {
+	{ 0x5a827999, 0x5a827999, 0x5a827999, 0x5a827999 },
+	{ 0x6ed9eba1, 0x6ed9eba1, 0x6ed9eba1, 0x6ed9eba1 },
+	{ 0x8f1bbcdc, 0x8f1bbcdc, 0x8f1bbcdc, 0x8f1bbcdc },
+	{ 0xca62c1d6, 0xca62c1d6, 0xca62c1d6, 0xca62c1d6 },
+};
+
+/*
+ * Four rounds with the message words in m0, using the choose (c), parity
+ * (p) or majority (m) function. When update is set, m0 is replaced with
+ * the message words 16 positions later, calculated from m0..m3
+ * (sha1su0/sha1su1). e only uses the first lane.
+ */
+#define SHA1_ROUNDS4(op, i, m0, m1, m2, m3, update)			\
+	do {								\
+		u32x4 wk = m0 + sha1_k[(i) / 5], e_next;		\
+									\
+		asm("sha1h %s0, %s1" : "=w" (e_next) : "w" (abcd));	\
+		asm("sha1" op " %q0, %s1, %2.4s"			\
+		    : "+w" (abcd) : "w" (e), "w" (wk));			\
+		e = e_next;						\
+									\
+		if (update) {						\
+			asm("sha1su0 %0.4s, %1.4s, %2.4s"		\
+			    : "+w" (m0) : "w" (m1), "w" (m2));		\
+			asm("sha1su1 %0.4s, %1.4s"			\
+			    : "+w" (m0) : "w" (m3));			\
+		}							\
+	} while (0)
+
+static void sha1_ce_transform(u32 *state, const u8 *data,
+			      unsigned int blocks)
+{
+	u32x4 abcd, e = { state[4] }, m0, m1, m2, m3;
+
+	memcpy(&abcd, &state[0], sizeof(abcd));
+
+	while (blocks--) {
+		u32x4 abcd_save = abcd, e_save = e;
+
+		memcpy(&m0, data, sizeof(m0));
+		memcpy(&m1, data + 16, sizeof(m1));
+		memcpy(&m2, data + 32, sizeof(m2));
+		memcpy(&m3, data + 48, sizeof(m3));
+		data += SHA1_BLOCK_SIZE;
+
+		/* the message words are big endian */
+		asm("rev32 %0.16b, %0.16b" : "+w" (m0));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m1));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m2));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m3));
+
+		SHA1_ROUNDS4("c", 0, m0, m1, m2, m3, 1);
+		SHA1_ROUNDS4("c", 1, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4("c", 2, m2, m3, m0, m1, 1);
+		SHA1_ROUNDS4("c", 3, m3, m0, m1, m2, 1);
+		SHA1_ROUNDS4("c", 4, m0, m1, m2, m3, 1);
+		SHA1_ROUNDS4("p", 5, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4("p", 6, m2, m3, m0, m1, 1);
+		SHA1_ROUNDS4("p", 7, m3, m0, m1, m2, 1);
+		SHA1_ROUNDS4("p", 8, m0, m1, m2, m3, 1);
+		SHA1_ROUNDS4("p", 9, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4("m", 10, m2, m3, m0, m1, 1);
+		SHA1_ROUNDS4("m", 11, m3, m0, m1, m2, 1);
+		SHA1_ROUNDS4("m", 12, m0, m1, m2, m3, 1);
+		SHA1_ROUNDS4("m", 13, m1, m2, m3, m0, 1);
+		SHA1_ROUNDS4("m", 14, m2, m3, m0, m1, 1);
+		SHA1_ROUNDS4("p", 15, m3, m0, m1, m2, 1);
+		SHA1_ROUNDS4("p", 16, m0, m1, m2, m3, 0);
+		SHA1_ROUNDS4("p", 17, m1, m2, m3, m0, 0);
+		SHA1_ROUNDS4("p", 18, m2, m3, m0, m1, 0);
+		SHA1_ROUNDS4("p", 19, m3, m0, m1, m2, 0);
+
+		abcd += abcd_save;
+		e += e_save;
+	}
+
+	memcpy(&state[0], &abcd, sizeof(abcd));
+	state[4] = e[0];
+}
+
+static int sha1_ce_init(struct digest *desc)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+
+	*sctx = (struct sha1_state){
+		.state = { SHA1_H0, SHA1_H1, SHA1_H2, SHA1_H3, SHA1_H4 },
+	};
+
+	return 0;
+}
+
+static void __sha1_ce_update(struct sha1_state *sctx, const u8 *data,
+			     unsigned int len, unsigned int partial)
+{
+	unsigned int done = 0;
+
+	sctx->count += len;
+
+	if (partial) {
+		done = SHA1_BLOCK_SIZE - partial;
+		memcpy(sctx->buffer + partial, data, done);
+		sha1_ce_transform(sctx->state, sctx->buffer, 1);
+	}
+
+	if (len - done >= SHA1_BLOCK_SIZE) {
+		const unsigned int blocks = (len - done) / SHA1_BLOCK_SIZE;
+
+		sha1_ce_transform(sctx->state, data + done, blocks);
+		done += blocks * SHA1_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buffer, data + done, len - done);
+}
+
+static int sha1_ce_update(struct digest *desc, const void *data,
+			  unsigned long len)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+
+	/* __sha1_ce_update() takes the length as unsigned int */
+	while (len) {
+		unsigned int now = min_t(unsigned long, len,
+				round_down(UINT_MAX, SHA1_BLOCK_SIZE));
+		unsigned int partial = sctx->count % SHA1_BLOCK_SIZE;
+
+		/* Handle the fast case right here */
+		if (partial + now < SHA1_BLOCK_SIZE) {
+			sctx->count += now;
+			memcpy(sctx->buffer + partial, data, now);
+		} else {
+			__sha1_ce_update(sctx, data, now, partial);
+		}
+
+		data += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/* Add padding and return the message digest. */
+static int sha1_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+	unsigned int i, index, padlen;
+	__be32 *dst = (__be32 *)out;
+	__be64 bits;
+	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
+
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64 and append length */
+	index = sctx->count % SHA1_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) : ((SHA1_BLOCK_SIZE+56) - index);
+	/* We need to fill a whole block for __sha1_ce_update() */
+	if (padlen <= 56) {
+		sctx->count += padlen;
+		memcpy(sctx->buffer + index, padding, padlen);
+	} else {
+		__sha1_ce_update(sctx, padding, padlen, index);
+	}
+	__sha1_ce_update(sctx, (const u8 *)&bits, sizeof(bits), 56);
+
+	/* Store state in digest */
+	for (i = 0; i < 5; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static struct digest_algo m = {
+	.base = {
+		.name		=	"sha1",
+		.driver_name	=	"sha1-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA1,
+	},
+
+	.init	=	sha1_ce_init,
+	.update	=	sha1_ce_update,
+	.final	=	sha1_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.length	=	SHA1_DIGEST_SIZE,
+	.ctx_length =	sizeof(struct sha1_state),
+};
+
+static int sha1_ce_digest_register(void)
+{
+	if (!cpu_has_isar0_feature(ID_AA64ISAR0_SHA1_SHIFT))
+		return 0;
+
+	return digest_algo_register(&m);
+}
+coredevice_initcall(sha1_ce_digest_register);
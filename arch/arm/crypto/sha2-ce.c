@@ -0,0 +1,285 @@
+/*
+ * SHA-224/SHA-256 using the ARMv8 Crypto Extensions
+ *
+ * Based on sha256_glue.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/internal.h>
+#include <asm/byteorder.h>
+#include <asm/system.h>
+
+typedef u32 u32x4 __attribute__((vector_size(16)));
+
+static const u32x4 sha256_k[16] = {
+	{ 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5 },
+	{ 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5 },
+	{ 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3 },
+	{ 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174 },
+	{ 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc },
+	{ 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da },
+	{ 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7 },
+	{ 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967 },
+	{ 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13 },
+	{ 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85 },
+	{ 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3 },
+	{ 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070 },
+	{ 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5 },
+	{ 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3 },
+	{ 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208 },
+	{ 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 },
+};
+
+/*
+ * Four rounds with the message words in m0. When update is set, m0 is
+ * replaced with the message words 16 positions later, calculated from
+ * m0..m3 (sha256su0/sha256su1).
+ */
+#define SHA256_ROUNDS4(i, m0, m1, m2, m3, update)			\
+	do {								\
+		u32x4 wk = m0 + sha256_k[i], t = abcd;			\
+									\
+		if (update) {						\
+			asm("sha256su0 %0.4s, %1.4s"			\
+			    : "+w" (m0) : "w" (m1));			\
+			asm("sha256su1 %0.4s, %1.4s, %2.4s"		\
+			    : "+w" (m0) : "w" (m2), "w" (m3));		\
+		}							\
+		asm("sha256h %q0, %q1, %2.4s"				\
+		    : "+w" (abcd) : "w" (efgh), "w" (wk));		\
+		asm("sha256h2 %q0, %q1, %2.4s"				\
+		    : "+w" (efgh) : "w" (t), "w" (wk));			\
+	} while (0)
+
+static void sha256_ce_transform(u32 *state, const u8 *data,
+				unsigned int blocks)
+{
+	u32x4 abcd, efgh, m0, m1, m2, m3;
+	int i;
+
+	memcpy(&abcd, &state[0], sizeof(abcd));
+	memcpy(&efgh, &state[4], sizeof(efgh));
+
+	while (blocks--) {
+		u32x4 abcd_save = abcd, efgh_save = efgh;
+
+		memcpy(&m0, data, sizeof(m0));
+		memcpy(&m1, data + 16, sizeof(m1));
+		memcpy(&m2, data + 32, sizeof(m2));
+		memcpy(&m3, data + 48, sizeof(m3));
+		data += SHA256_BLOCK_SIZE;
+
+		/* the message words are big endian */
+		asm("rev32 %0.16b, %0.16b" : "+w" (m0));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m1));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m2));
+		asm("rev32 %0.16b, %0.16b" : "+w" (m3));
+
+		for (i = 0; i < 12; i += 4) {
+			SHA256_ROUNDS4(i + 0, m0, m1, m2, m3, 1);
+			SHA256_ROUNDS4(i + 1, m1, m2, m3, m0, 1);
+			SHA256_ROUNDS4(i + 2, m2, m3, m0, m1, 1);
+			SHA256_ROUNDS4(i + 3, m3, m0, m1, m2, 1);
+		}
+
+		SHA256_ROUNDS4(12, m0, m1, m2, m3, 0);
+		SHA256_ROUNDS4(13, m1, m2, m3, m0, 0);
+		SHA256_ROUNDS4(14, m2, m3, m0, m1, 0);
+		SHA256_ROUNDS4(15, m3, m0, m1, m2, 0);
+
+		abcd += abcd_save;
+		efgh += efgh_save;
+	}
+
+	memcpy(&state[0], &abcd, sizeof(abcd));
+	memcpy(&state[4], &efgh, sizeof(efgh));
+}
+
+static int sha256_ce_init(struct digest *desc)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA256_H0, SHA256_H1, SHA256_H2, SHA256_H3,
+			   SHA256_H4, SHA256_H5, SHA256_H6, SHA256_H7 },
+	};
+
+	return 0;
+}
+
+static int sha224_ce_init(struct digest *desc)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA224_H0, SHA224_H1, SHA224_H2, SHA224_H3,
+			   SHA224_H4, SHA224_H5, SHA224_H6, SHA224_H7 },
+	};
+
+	return 0;
+}
+
+static void __sha256_ce_update(struct sha256_state *sctx, const u8 *data,
+			       unsigned int len, unsigned int partial)
+{
+	unsigned int done = 0;
+
+	sctx->count += len;
+
+	if (partial) {
+		done = SHA256_BLOCK_SIZE - partial;
+		memcpy(sctx->buf + partial, data, done);
+		sha256_ce_transform(sctx->state, sctx->buf, 1);
+	}
+
+	if (len - done >= SHA256_BLOCK_SIZE) {
+		const unsigned int blocks = (len - done) / SHA256_BLOCK_SIZE;
+
+		sha256_ce_transform(sctx->state, data + done, blocks);
+		done += blocks * SHA256_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buf, data + done, len - done);
+}
+
+static int sha256_ce_update(struct digest *desc, const void *data,
+			    unsigned long len)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+
+	/* __sha256_ce_update() takes the length as unsigned int */
+	while (len) {
+		unsigned int now = min_t(unsigned long, len,
+				round_down(UINT_MAX, SHA256_BLOCK_SIZE));
+		unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+
+		/* Handle the fast case right here */
+		if (partial + now < SHA256_BLOCK_SIZE) {
+			sctx->count += now;
+			memcpy(sctx->buf + partial, data, now);
+		} else {
+			__sha256_ce_update(sctx, data, now, partial);
+		}
+
+		data += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/* Add padding and return the message digest. */
+static void sha256_ce_pad(struct sha256_state *sctx)
+{
+	unsigned int index, padlen;
+	__be64 bits;
+	static const u8 padding[SHA256_BLOCK_SIZE] = { 0x80, };
+
+	/* save number of bits */
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64 and append length */
+	index = sctx->count % SHA256_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) : ((SHA256_BLOCK_SIZE+56)-index);
+
+	/* We need to fill a whole block for __sha256_ce_update */
+	if (padlen <= 56) {
+		sctx->count += padlen;
+		memcpy(sctx->buf + index, padding, padlen);
+	} else {
+		__sha256_ce_update(sctx, padding, padlen, index);
+	}
+	__sha256_ce_update(sctx, (const u8 *)&bits, sizeof(bits), 56);
+}
+
+static int sha256_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	__be32 *dst = (__be32 *)out;
+	int i;
+
+	sha256_ce_pad(sctx);
+
+	for (i = 0; i < 8; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static int sha224_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	__be32 *dst = (__be32 *)out;
+	int i;
+
+	sha256_ce_pad(sctx);
+
+	for (i = 0; i < 7; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static struct digest_algo sha224 = {
+	.base = {
+		.name		=	"sha224",
+		.driver_name	=	"sha224-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA224,
+	},
+
+	.length	=	SHA224_DIGEST_SIZE,
+	.init	=	sha224_ce_init,
+	.update	=	sha256_ce_update,
+	.final	=	sha224_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static struct digest_algo sha256 = {
+	.base = {
+		.name		=	"sha256",
+		.driver_name	=	"sha256-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA256,
+	},
+
+	.length	=	SHA256_DIGEST_SIZE,
+	.init	=	sha256_ce_init,
+	.update	=	sha256_ce_update,
+	.final	=	sha256_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static int sha2_ce_digest_register(void)
+{
+	int ret;
+
+	if (!cpu_has_isar0_feature(ID_AA64ISAR0_SHA2_SHIFT))
+		return 0;
+
+	ret = digest_algo_register(&sha224);
+	if (ret)
+		return ret;
+
+	return digest_algo_register(&sha256);
+}
+coredevice_initcall(sha2_ce_digest_register);
@@ -0,0 +1,9 @@
+#ifndef __ASM_ARM_CRC32_H
+#define __ASM_ARM_CRC32_H
+
+#include <linux/types.h>
+
+bool crc32_arm64_available(void);
+uint32_t crc32_le_arm64(uint32_t crc, const void *buf, unsigned int len);
+
+#endif /* __ASM_ARM_CRC32_H */
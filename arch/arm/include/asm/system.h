@@ -78,6 +78,27 @@ static inline unsigned long read_mpidr(void)
 	return val;
 }
 #endif
+
+#ifdef CONFIG_CPU_64v8
+#define ID_AA64ISAR0_SHA1_SHIFT		8
+#define ID_AA64ISAR0_SHA2_SHIFT		12
+#define ID_AA64ISAR0_CRC32_SHIFT	16
+
+/* Instruction set attribute register with the crypto and CRC32 features */
+static inline unsigned long read_id_aa64isar0(void)
+{
+	unsigned long val;
+
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (val));
+
+	return val;
+}
+
+static inline int cpu_has_isar0_feature(int shift)
+{
+	return (read_id_aa64isar0() >> shift) & 0xf;
+}
+#endif
 static inline unsigned int get_cr(void)
 {
 	unsigned int val;
@@ -0,0 +1,65 @@
+/*
+ * CRC32 using the instructions of the ARMv8 CRC32 extension
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+#include <common.h>
+#include <asm/crc32.h>
+#include <asm/system.h>
+#include <asm/unaligned.h>
+
+#define CRC32_INSN(insn, w, crc, val)				\
+	asm(".arch_extension crc\n"				\
+	    insn " %w0, %w0, %" w "1" : "+r" (crc) : "r" (val))
+
+static int crc32_arm64_supported = -1;
+
+bool crc32_arm64_available(void)
+{
+	if (crc32_arm64_supported < 0)
+		crc32_arm64_supported =
+			cpu_has_isar0_feature(ID_AA64ISAR0_CRC32_SHIFT) != 0;
+
+	return crc32_arm64_supported;
+}
+
+/*
+ * The CRC32 instructions implement the reflected 0x04c11db7 polynomial
+ * without pre- and post-inversion, which is exactly what crc32_le_generic() in
+ * crypto/crc32.c does with its tables.
+ */
+uint32_t crc32_le_arm64(uint32_t crc, const void *_buf, unsigned int len)
+{
+	const u8 *buf = _buf;
+
+	while (len >= 8) {
+		CRC32_INSN("crc32x", "x", crc, get_unaligned_le64(buf));
+		buf += 8;
+		len -= 8;
+	}
+
+	if (len >= 4) {
+		CRC32_INSN("crc32w", "w", crc, get_unaligned_le32(buf));
+		buf += 4;
+		len -= 4;
+	}
+
+	if (len >= 2) {
+		CRC32_INSN("crc32h", "w", crc, get_unaligned_le16(buf));
+		buf += 2;
+		len -= 2;
+	}
+
+	if (len)
+		CRC32_INSN("crc32b", "w", crc, *buf);
+
+	return crc;
+}
@@ -26,9 +26,8 @@
 
 static int do_barebox_update(int argc, char *argv[])
 {
-	int opt, ret, repair = 0;
+	int opt, repair = 0;
 	struct bbu_data data = {};
-	void *image = NULL;
 
 	while ((opt = getopt(argc, argv, "t:yf:ld:r")) > 0) {
 		switch (opt) {
@@ -59,21 +58,12 @@ static int do_barebox_update(int argc, char *argv[])
 
 	if (argc - optind > 0) {
 		data.imagefile = argv[optind];
-
-		image = read_file(data.imagefile, &data.len);
-		if (!image)
-			return -errno;
-		data.image = image;
 	} else {
 		if (!repair)
 			return COMMAND_ERROR_USAGE;
 	}
 
-	ret = barebox_update(&data);
-
-	free(image);
-
-	return ret;
+	return barebox_update(&data);
 }
 
 BAREBOX_CMD_HELP_START(barebox_update)
@@ -0,0 +1,124 @@
+/*
+ * blkbench - measure block layer cache performance
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <common.h>
+#include <command.h>
+#include <getopt.h>
+#include <block.h>
+#include <bench.h>
+#include <clock.h>
+#include <malloc.h>
+#include <errno.h>
+
+static int do_blkbench(int argc, char *argv[])
+{
+	struct block_device *blk, *b;
+	unsigned long size = 0, loops = 100, i;
+	int num_blocks, block, opt, ret = 0;
+	struct bench_result res;
+	u64 start;
+	void *buf;
+
+	while ((opt = getopt(argc, argv, "s:n:")) > 0) {
+		switch (opt) {
+		case 's':
+			size = strtoul_suffix(optarg, NULL, 0);
+			break;
+		case 'n':
+			loops = simple_strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return COMMAND_ERROR_USAGE;
+		}
+	}
+
+	if (optind != argc - 1)
+		return COMMAND_ERROR_USAGE;
+
+	blk = NULL;
+	for_each_block_device(b) {
+		if (!strcmp(b->cdev.name, argv[optind])) {
+			blk = b;
+			break;
+		}
+	}
+
+	if (!blk) {
+		printf("no such block device: %s\n", argv[optind]);
+		return 1;
+	}
+
+	/* by default use an area which fits into the cache */
+	if (!size)
+		size = blk->cache_chunks * blk->cache_chunksize;
+
+	num_blocks = min_t(unsigned long, size >> blk->blockbits,
+			blk->num_blocks);
+	if (!num_blocks || !loops)
+		return COMMAND_ERROR_USAGE;
+
+	buf = xmalloc(1 << blk->blockbits);
+
+	/* warm up the cache */
+	for (block = 0; block < num_blocks; block++) {
+		ret = block_read(blk, buf, block, 1);
+		if (ret)
+			goto out;
+	}
+
+	start = get_time_ns();
+
+	for (i = 0; i < loops; i++) {
+		for (block = 0; block < num_blocks; block++) {
+			ret = block_read(blk, buf, block, 1);
+			if (ret)
+				goto out;
+		}
+
+		if (ctrlc()) {
+			ret = -EINTR;
+			goto out;
+		}
+	}
+
+	bench_stop(start, (u64)loops * num_blocks << blk->blockbits, &res);
+
+	printf("%lu x %d blocks in %llums: %llu KiB/s\n", loops, num_blocks,
+			res.ms, res.kbps);
+out:
+	free(buf);
+
+	if (ret)
+		printf("%s: %s\n", argv[optind], strerror(-ret));
+
+	return ret ? 1 : 0;
+}
+
+BAREBOX_CMD_HELP_START(blkbench)
+BAREBOX_CMD_HELP_TEXT("Measure the throughput of reading cached data from a block")
+BAREBOX_CMD_HELP_TEXT("device one block at a time. The area is read once to fill the")
+BAREBOX_CMD_HELP_TEXT("cache before measuring.")
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("Options:")
+BAREBOX_CMD_HELP_OPT ("-s SIZE", "size of the area to read (default: cache size)")
+BAREBOX_CMD_HELP_OPT ("-n LOOPS", "number of times to read the area (default 100)")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(blkbench)
+	.cmd		= do_blkbench,
+	BAREBOX_CMD_DESC("measure cached block device read throughput")
+	BAREBOX_CMD_OPTS("[-sn] DEVICE")
+	BAREBOX_CMD_GROUP(CMD_GRP_MISC)
+	BAREBOX_CMD_HELP(cmd_blkbench_help)
+BAREBOX_CMD_END
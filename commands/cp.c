@@ -27,6 +27,34 @@
 #include <libgen.h>
 #include <getopt.h>
 #include <libfile.h>
+#include <digest.h>
+
+static int cp_file(const char *src, const char *dst, int verbose,
+		   struct digest *d)
+{
+	unsigned char *hash;
+	int i, ret;
+
+	if (!d)
+		return copy_file(src, dst, verbose);
+
+	ret = copy_file_digest(src, dst, verbose, d);
+	if (ret)
+		return ret;
+
+	hash = xzalloc(digest_length(d));
+
+	ret = digest_final(d, hash);
+	if (!ret) {
+		for (i = 0; i < digest_length(d); i++)
+			printf("%02x", hash[i]);
+		printf("  %s\n", dst);
+	}
+
+	free(hash);
+
+	return ret;
+}
 
 /**
  * @param[in] argc Argument count from command line
@@ -41,8 +69,10 @@ static int do_cp(int argc, char *argv[])
 	int opt;
 	int verbose = 0, recursive = 0;
 	int argc_min;
+	const char *algo = NULL;
+	struct digest *d = NULL;
 
-	while ((opt = getopt(argc, argv, "vr")) > 0) {
+	while ((opt = getopt(argc, argv, "vrd:")) > 0) {
 		switch (opt) {
 		case 'v':
 			verbose = 1;
@@ -50,14 +80,25 @@ static int do_cp(int argc, char *argv[])
 		case 'r':
 			recursive = 1;
 			break;
+		case 'd':
+			algo = optarg;
+			break;
 		}
 	}
 
 	argc_min = optind + 2;
 
-	if (argc < argc_min)
+	if (argc < argc_min || (algo && recursive))
 		return COMMAND_ERROR_USAGE;
 
+	if (algo) {
+		d = digest_alloc(algo);
+		if (!d) {
+			printf("cp: digest %s not found\n", algo);
+			return 1;
+		}
+	}
+
 	if (!stat(argv[argc - 1], &statbuf)) {
 		if (S_ISDIR(statbuf.st_mode))
 			last_is_dir = 1;
@@ -65,7 +106,8 @@ static int do_cp(int argc, char *argv[])
 
 	if (((recursive && argc - optind > 2) || (argc > argc_min)) && !last_is_dir) {
 		printf("cp: target `%s' is not a directory\n", argv[argc - 1]);
-		return 1;
+		ret = 1;
+		goto out;
 	}
 
 	if (recursive && argc - optind == 2 && !last_is_dir) {
@@ -82,9 +124,9 @@ static int do_cp(int argc, char *argv[])
 		if (recursive)
 			ret = copy_recursive(argv[i], dst);
 		else if (last_is_dir)
-			ret = copy_file(argv[i], dst, verbose);
+			ret = cp_file(argv[i], dst, verbose, d);
 		else
-			ret = copy_file(argv[i], argv[argc - 1], verbose);
+			ret = cp_file(argv[i], argv[argc - 1], verbose, d);
 
 		free(dst);
 		if (ret)
@@ -93,6 +135,8 @@ static int do_cp(int argc, char *argv[])
 
 	ret = 0;
 out:
+	digest_free(d);
+
 	return ret;
 }
 
@@ -101,12 +145,13 @@ BAREBOX_CMD_HELP_TEXT("Copy file from SRC to DEST.")
 BAREBOX_CMD_HELP_TEXT("")
 BAREBOX_CMD_HELP_TEXT("Options:")
 BAREBOX_CMD_HELP_OPT ("-v", "verbose")
+BAREBOX_CMD_HELP_OPT ("-d DIGEST", "print DIGEST (e.g. sha256) of the copied data")
 BAREBOX_CMD_HELP_END
 
 BAREBOX_CMD_START(cp)
 	.cmd		= do_cp,
 	BAREBOX_CMD_DESC("copy files")
-	BAREBOX_CMD_OPTS("[-v] SRC DEST")
+	BAREBOX_CMD_OPTS("[-v] [-d DIGEST] SRC DEST")
 	BAREBOX_CMD_GROUP(CMD_GRP_FILE)
 	BAREBOX_CMD_HELP(cmd_cp_help)
 BAREBOX_CMD_END
@@ -0,0 +1,97 @@
+/*
+ * crcbench - measure CRC32 throughput
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <common.h>
+#include <command.h>
+#include <getopt.h>
+#include <bench.h>
+#include <clock.h>
+#include <crc.h>
+#include <malloc.h>
+#include <linux/sizes.h>
+
+static int do_crcbench(int argc, char *argv[])
+{
+	unsigned long size = SZ_1M, loops = 16, offset = 0, i;
+	struct bench_result res;
+	u64 start;
+	uint32_t crc = 0;
+	unsigned char *buf;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "s:n:o:")) > 0) {
+		switch (opt) {
+		case 's':
+			size = strtoul_suffix(optarg, NULL, 0);
+			break;
+		case 'n':
+			loops = simple_strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			offset = simple_strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return COMMAND_ERROR_USAGE;
+		}
+	}
+
+	if (!size || !loops || size > UINT_MAX)
+		return COMMAND_ERROR_USAGE;
+
+	buf = malloc(size + offset);
+	if (!buf) {
+		printf("cannot allocate %lu bytes\n", size + offset);
+		return 1;
+	}
+
+	bench_fill_random(buf, size + offset);
+
+	start = get_time_ns();
+
+	for (i = 0; i < loops; i++) {
+		crc = crc32(crc, buf + offset, size);
+
+		if (ctrlc()) {
+			ret = 1;
+			goto out;
+		}
+	}
+
+	bench_stop(start, (u64)loops * size, &res);
+
+	printf("%lu x %lu bytes in %llums: %llu KiB/s (crc 0x%08x)\n", loops,
+			size, res.ms, res.kbps, crc);
+out:
+	free(buf);
+
+	return ret;
+}
+
+BAREBOX_CMD_HELP_START(crcbench)
+BAREBOX_CMD_HELP_TEXT("Measure the throughput of the CRC32 implementation on a buffer")
+BAREBOX_CMD_HELP_TEXT("filled with random data.")
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("Options:")
+BAREBOX_CMD_HELP_OPT ("-s SIZE", "size of the buffer (default 1M)")
+BAREBOX_CMD_HELP_OPT ("-n LOOPS", "number of times to checksum the buffer (default 16)")
+BAREBOX_CMD_HELP_OPT ("-o OFFSET", "start offset in the buffer, to test unaligned data")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(crcbench)
+	.cmd		= do_crcbench,
+	BAREBOX_CMD_DESC("measure CRC32 throughput")
+	BAREBOX_CMD_OPTS("[-sno]")
+	BAREBOX_CMD_GROUP(CMD_GRP_MISC)
+	BAREBOX_CMD_HELP(cmd_crcbench_help)
+BAREBOX_CMD_END
@@ -0,0 +1,124 @@
+/*
+ * digestbench - measure digest throughput
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <common.h>
+#include <command.h>
+#include <getopt.h>
+#include <bench.h>
+#include <clock.h>
+#include <digest.h>
+#include <malloc.h>
+#include <linux/sizes.h>
+
+static int do_digestbench(int argc, char *argv[])
+{
+	unsigned long size = SZ_1M, loops = 16, i;
+	struct bench_result res;
+	u64 start;
+	unsigned char *buf, *hash;
+	struct digest *d;
+	char *algo = NULL;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "a:s:n:")) > 0) {
+		switch (opt) {
+		case 'a':
+			algo = optarg;
+			break;
+		case 's':
+			size = strtoul_suffix(optarg, NULL, 0);
+			break;
+		case 'n':
+			loops = simple_strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return COMMAND_ERROR_USAGE;
+		}
+	}
+
+	if (!algo || !size || !loops)
+		return COMMAND_ERROR_USAGE;
+
+	d = digest_alloc(algo);
+	if (!d) {
+		printf("algo '%s' not found\n", algo);
+		return 1;
+	}
+
+	buf = malloc(size);
+	if (!buf) {
+		printf("cannot allocate %lu bytes\n", size);
+		digest_free(d);
+		return 1;
+	}
+
+	hash = xzalloc(digest_length(d));
+
+	bench_fill_random(buf, size);
+
+	start = get_time_ns();
+
+	ret = digest_init(d);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < loops; i++) {
+		ret = digest_update(d, buf, size);
+		if (ret)
+			goto out;
+
+		if (ctrlc()) {
+			ret = -EINTR;
+			goto out;
+		}
+	}
+
+	ret = digest_final(d, hash);
+	if (ret)
+		goto out;
+
+	bench_stop(start, (u64)loops * size, &res);
+
+	printf("%s: %lu x %lu bytes in %llums: %llu KiB/s\n",
+			digest_driver_name(d), loops, size, res.ms, res.kbps);
+out:
+	if (ret)
+		printf("%s: %s\n", digest_driver_name(d), strerror(-ret));
+
+	free(hash);
+	free(buf);
+	digest_free(d);
+
+	return ret ? 1 : 0;
+}
+
+BAREBOX_CMD_HELP_START(digestbench)
+BAREBOX_CMD_HELP_TEXT("Measure the throughput of a digest algorithm on a buffer filled")
+BAREBOX_CMD_HELP_TEXT("with random data. ALGO is either an algorithm name like sha256,")
+BAREBOX_CMD_HELP_TEXT("which selects the implementation with the highest priority, or")
+BAREBOX_CMD_HELP_TEXT("the driver name of a specific implementation like sha256-generic.")
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("Options:")
+BAREBOX_CMD_HELP_OPT ("-a ALGO", "digest algorithm or driver to use")
+BAREBOX_CMD_HELP_OPT ("-s SIZE", "size of the buffer (default 1M)")
+BAREBOX_CMD_HELP_OPT ("-n LOOPS", "number of times to hash the buffer (default 16)")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(digestbench)
+	.cmd		= do_digestbench,
+	BAREBOX_CMD_DESC("measure digest throughput")
+	BAREBOX_CMD_OPTS("-a ALGO [-sn]")
+	BAREBOX_CMD_GROUP(CMD_GRP_MISC)
+	BAREBOX_CMD_HELP(cmd_digestbench_help)
+BAREBOX_CMD_END
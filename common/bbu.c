@@ -27,6 +27,10 @@
 #include <malloc.h>
 #include <linux/stat.h>
 #include <image-metadata.h>
+#include <digest.h>
+#include <ioctl.h>
+#include <linux/sizes.h>
+#include <linux/mtd/mtd-abi.h>
 
 static LIST_HEAD(bbu_image_handlers);
 
@@ -227,12 +231,62 @@ static int bbu_check_metadata(struct bbu_data *data)
 	return 0;
 }
 
+/*
+ * Size of the part of the image which is kept in memory when a handler
+ * streams the image. This is used for detecting the file type and for
+ * finding the image metadata.
+ */
+#define BBU_STREAM_HEAD_SIZE	SZ_1M
+
+/*
+ * Read the image given in data->imagefile. Handlers which can stream the
+ * image only get the head of big images, everything else gets the whole
+ * image.
+ */
+static int bbu_read_image(struct bbu_handler *handler, struct bbu_data *data)
+{
+	struct stat s;
+	size_t len;
+	void *buf;
+	int ret;
+
+	if (handler->flags & BBU_HANDLER_CAN_STREAM) {
+		ret = stat(data->imagefile, &s);
+		if (ret)
+			return ret;
+
+		if (s.st_size != FILE_SIZE_STREAM &&
+		    s.st_size > BBU_STREAM_HEAD_SIZE) {
+			ret = read_file_2(data->imagefile, &len, &buf,
+					  BBU_STREAM_HEAD_SIZE);
+			if (ret && ret != -EFBIG)
+				return ret;
+
+			data->flags |= BBU_FLAG_STREAM;
+			data->image_size = s.st_size;
+			goto out;
+		}
+	}
+
+	buf = read_file(data->imagefile, &len);
+	if (!buf)
+		return -errno;
+
+	data->image_size = len;
+out:
+	data->image = buf;
+	data->len = len;
+
+	return 0;
+}
+
 /*
  * do a barebox update with data from *data
  */
 int barebox_update(struct bbu_data *data)
 {
 	struct bbu_handler *handler;
+	void *image = NULL;
 	int ret;
 
 	handler = bbu_find_handler_by_device(data->devicefile);
@@ -249,6 +303,16 @@ int barebox_update(struct bbu_data *data)
 		return -EINVAL;
 	}
 
+	if (!data->image && data->imagefile) {
+		ret = bbu_read_image(handler, data);
+		if (ret)
+			return ret;
+		image = (void *)data->image;
+	}
+
+	if (!data->image_size)
+		data->image_size = data->len;
+
 	if (!data->handler_name)
 		data->handler_name = handler->name;
 
@@ -257,7 +321,7 @@ int barebox_update(struct bbu_data *data)
 
 	ret = bbu_check_metadata(data);
 	if (ret)
-		return ret;
+		goto out;
 
 	ret = handler->handler(handler, data);
 	if (ret == -EINTR)
@@ -265,6 +329,12 @@ int barebox_update(struct bbu_data *data)
 
 	if (!ret)
 		printf("update succeeded\n");
+out:
+	if (image) {
+		free(image);
+		data->image = NULL;
+		data->flags &= ~BBU_FLAG_STREAM;
+	}
 
 	return ret;
 }
@@ -309,6 +379,166 @@ struct bbu_std {
 	enum filetype filetype;
 };
 
+/* Granularity in which streamed images are erased and written */
+#define BBU_STREAM_CHUNK_SIZE	SZ_256K
+
+/*
+ * Verify the data written to @fd against the digest of the image in @d.
+ * Images are streamed through a buffer smaller than the image, so the
+ * data can't be compared directly.
+ */
+static int bbu_stream_verify(struct bbu_data *data, int fd, struct digest *d,
+			     void *buf, size_t bufsize)
+{
+	unsigned char *hash;
+	loff_t ofs = 0;
+	int now, ret;
+
+	hash = xzalloc(digest_length(d));
+
+	ret = digest_final(d, hash);
+	if (ret)
+		goto out;
+
+	ret = digest_init(d);
+	if (ret)
+		goto out;
+
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	while (ofs < data->image_size) {
+		now = read_full(fd, buf, min_t(loff_t, bufsize,
+					       data->image_size - ofs));
+		if (now <= 0) {
+			ret = now ? now : -EIO;
+			goto out;
+		}
+
+		ret = digest_update(d, buf, now);
+		if (ret)
+			goto out;
+
+		ofs += now;
+	}
+
+	ret = digest_verify(d, hash);
+	if (ret)
+		printf("verifying %s failed, data written differs from image\n",
+		       data->devicefile);
+out:
+	free(hash);
+
+	return ret;
+}
+
+/*
+ * Copy the image from data->imagefile to @fd in chunks, erasing each chunk
+ * just before it is written. The image is hashed while it is copied and the
+ * result is verified afterwards if a suitable digest is available.
+ */
+static int bbu_std_file_stream(struct bbu_data *data, int fd)
+{
+	struct mtd_info_user meminfo;
+	struct digest *d;
+	size_t bufsize = BBU_STREAM_CHUNK_SIZE;
+	loff_t ofs = 0;
+	void *buf;
+	int srcfd, now, ret;
+
+	/* erase whole eraseblocks only, we must not erase written data again */
+	ret = ioctl(fd, MEMGETINFO, &meminfo);
+	if (!ret && meminfo.erasesize > bufsize)
+		bufsize = meminfo.erasesize;
+	else if (!ret && meminfo.erasesize)
+		bufsize = ALIGN(bufsize, meminfo.erasesize);
+
+	srcfd = open(data->imagefile, O_RDONLY);
+	if (srcfd < 0)
+		return srcfd;
+
+	buf = malloc(bufsize);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto err_close;
+	}
+
+	d = digest_alloc("sha256");
+	if (d) {
+		ret = digest_init(d);
+		if (ret)
+			goto err_free;
+	}
+
+	while (ofs < data->image_size) {
+		now = read_full(srcfd, buf, min_t(loff_t, bufsize,
+						  data->image_size - ofs));
+		if (now < 0) {
+			ret = now;
+			goto err_free;
+		}
+
+		if (!now) {
+			printf("%s: short read, image has changed?\n",
+			       data->imagefile);
+			ret = -EIO;
+			goto err_free;
+		}
+
+		if (d) {
+			ret = digest_update(d, buf, now);
+			if (ret)
+				goto err_free;
+		}
+
+		ret = erase(fd, now, ofs);
+		if (ret && ret != -ENOSYS) {
+			printf("erasing %s failed with %s\n", data->devicefile,
+					strerror(-ret));
+			goto err_free;
+		}
+
+		ret = write_full(fd, buf, now);
+		if (ret < 0)
+			goto err_free;
+
+		ofs += now;
+	}
+
+	if (d)
+		ret = bbu_stream_verify(data, fd, d, buf, bufsize);
+	else
+		ret = 0;
+
+err_free:
+	digest_free(d);
+	free(buf);
+err_close:
+	close(srcfd);
+
+	return ret;
+}
+
+static int bbu_std_file_write(struct bbu_data *data, int fd)
+{
+	int ret;
+
+	ret = erase(fd, data->len, 0);
+	if (ret && ret != -ENOSYS) {
+		printf("erasing %s failed with %s\n", data->devicefile,
+				strerror(-ret));
+		return ret;
+	}
+
+	ret = write_full(fd, data->image, data->len);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
 static int bbu_std_file_handler(struct bbu_handler *handler,
 					struct bbu_data *data)
 {
@@ -330,9 +560,9 @@ static int bbu_std_file_handler(struct bbu_handler *handler,
 	if (ret) {
 		oflags |= O_CREAT;
 	} else {
-		if (!S_ISREG(s.st_mode) && s.st_size < data->len) {
-			printf("Image (%zd) is too big for device (%lld)\n",
-					data->len, s.st_size);
+		if (!S_ISREG(s.st_mode) && s.st_size < data->image_size) {
+			printf("Image (%lld) is too big for device (%lld)\n",
+					data->image_size, s.st_size);
 		}
 	}
 
@@ -340,29 +570,29 @@ static int bbu_std_file_handler(struct bbu_handler *handler,
 	if (ret)
 		return ret;
 
+	/* streamed images are read back for verification */
+	if (data->flags & BBU_FLAG_STREAM)
+		oflags = (oflags & ~O_WRONLY) | O_RDWR;
+
 	fd = open(data->devicefile, oflags);
 	if (fd < 0)
 		return fd;
 
-	ret = protect(fd, data->len, 0, 0);
+	ret = protect(fd, data->image_size, 0, 0);
 	if (ret && ret != -ENOSYS) {
 		printf("unprotecting %s failed with %s\n", data->devicefile,
 				strerror(-ret));
 		goto err_close;
 	}
 
-	ret = erase(fd, data->len, 0);
-	if (ret && ret != -ENOSYS) {
-		printf("erasing %s failed with %s\n", data->devicefile,
-				strerror(-ret));
-		goto err_close;
-	}
-
-	ret = write_full(fd, data->image, data->len);
-	if (ret < 0)
+	if (data->flags & BBU_FLAG_STREAM)
+		ret = bbu_std_file_stream(data, fd);
+	else
+		ret = bbu_std_file_write(data, fd);
+	if (ret)
 		goto err_close;
 
-	protect(fd, data->len, 0, 1);
+	protect(fd, data->image_size, 0, 1);
 
 	ret = 0;
 
@@ -403,6 +633,7 @@ int bbu_register_std_file_update(const char *name, unsigned long flags,
 	handler->devicefile = devicefile;
 	handler->name = name;
 	handler->handler = bbu_std_file_handler;
+	handler->flags |= BBU_HANDLER_CAN_STREAM;
 
 	ret = bbu_register_handler(handler);
 	if (ret)
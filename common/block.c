@@ -21,10 +21,25 @@
 #include <malloc.h>
 #include <linux/err.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
+#include <linux/sizes.h>
 #include <dma.h>
+#include <globalvar.h>
+#include <magicvar.h>
+#include <init.h>
 
 #define BLOCKSIZE(blk)	(1 << blk->blockbits)
 
+/*
+ * Upper limit for a single direct read. Many drivers can not transfer more
+ * than a 16 bit block counter allows in one request.
+ */
+#define BLOCK_MAX_DIRECT_BLOCKS	0xffff
+
+/* Upper limit for the memory used by the cache of a single block device */
+#define BLOCK_CACHE_MAX		SZ_16M
+
 LIST_HEAD(block_device_list);
 
 /* a chunk of contigous data */
@@ -34,9 +49,13 @@ struct chunk {
 	int dirty; /* need to write back to device */
 	int num; /* number of chunk, debugging only */
 	struct list_head list;
+	struct rb_node node; /* in blk->chunk_tree, keyed by block_start */
 };
 
-#define BUFSIZE (PAGE_SIZE * 16)
+/* defaults for newly registered block devices */
+static int block_cache_chunks = 8;
+static int block_cache_chunksize = PAGE_SIZE * 16;
+static int block_readahead = 2;
 
 /*
  * Write all dirty chunks back to the device
@@ -61,6 +80,60 @@ static int writebuffer_flush(struct block_device *blk)
 	return 0;
 }
 
+/*
+ * Add a chunk to the cached chunks. The chunk becomes the most
+ * recently used one.
+ */
+static void chunk_add_cached(struct block_device *blk, struct chunk *chunk)
+{
+	struct rb_node **p = &blk->chunk_tree.rb_node, *parent = NULL;
+
+	while (*p) {
+		struct chunk *c = rb_entry(*p, struct chunk, node);
+
+		parent = *p;
+		if (chunk->block_start < c->block_start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&chunk->node, parent, p);
+	rb_insert_color(&chunk->node, &blk->chunk_tree);
+
+	list_add(&chunk->list, &blk->buffered_blocks);
+}
+
+static void chunk_del_cached(struct block_device *blk, struct chunk *chunk)
+{
+	rb_erase(&chunk->node, &blk->chunk_tree);
+	RB_CLEAR_NODE(&chunk->node);
+	list_del(&chunk->list);
+}
+
+/*
+ * get the chunk containing a given block without changing the LRU
+ * order. Will return NULL if the block is not cached.
+ */
+static struct chunk *chunk_lookup(struct block_device *blk, int block)
+{
+	struct rb_node *n = blk->chunk_tree.rb_node;
+	int start = block & ~blk->blkmask;
+
+	while (n) {
+		struct chunk *chunk = rb_entry(n, struct chunk, node);
+
+		if (start < chunk->block_start)
+			n = n->rb_left;
+		else if (start > chunk->block_start)
+			n = n->rb_right;
+		else
+			return chunk;
+	}
+
+	return NULL;
+}
+
 /*
  * get the chunk containing a given block. Will return NULL if the
  * block is not cached, the chunk otherwise.
@@ -69,19 +142,18 @@ static struct chunk *chunk_get_cached(struct block_device *blk, int block)
 {
 	struct chunk *chunk;
 
-	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
-		if (block >= chunk->block_start &&
-				block < chunk->block_start + blk->rdbufsize) {
-			debug("%s: found %d in %d\n", __func__, block, chunk->num);
-			/*
-			 * move most recently used entry to the head of the list
-			 */
-			list_move(&chunk->list, &blk->buffered_blocks);
-			return chunk;
-		}
-	}
+	chunk = chunk_lookup(blk, block);
+	if (!chunk)
+		return NULL;
 
-	return NULL;
+	debug("%s: found %d in %d\n", __func__, block, chunk->num);
+
+	/*
+	 * move most recently used entry to the head of the list
+	 */
+	list_move(&chunk->list, &blk->buffered_blocks);
+
+	return chunk;
 }
 
 /*
@@ -99,6 +171,22 @@ static void *block_get_cached(struct block_device *blk, int block)
 	return chunk->data + (block - chunk->block_start) * BLOCKSIZE(blk);
 }
 
+/*
+ * Write back a cached chunk if necessary and remove it from the cache
+ */
+static void chunk_evict(struct block_device *blk, struct chunk *chunk)
+{
+	if (chunk->dirty) {
+		size_t num_blocks = min(blk->rdbufsize,
+				blk->num_blocks - chunk->block_start);
+		blk->ops->write(blk, chunk->data, chunk->block_start,
+				num_blocks);
+		chunk->dirty = 0;
+	}
+
+	chunk_del_cached(blk, chunk);
+}
+
 /*
  * Get a data chunk, either from the idle list or if the idle list
  * is empty, the least recently used is written back to disk and
@@ -111,15 +199,7 @@ static struct chunk *get_chunk(struct block_device *blk)
 	if (list_empty(&blk->idle_blocks)) {
 		/* use last entry which is the most unused */
 		chunk = list_last_entry(&blk->buffered_blocks, struct chunk, list);
-		if (chunk->dirty) {
-			size_t num_blocks = min(blk->rdbufsize,
-					blk->num_blocks - chunk->block_start);
-			blk->ops->write(blk, chunk->data, chunk->block_start,
-					num_blocks);
-			chunk->dirty = 0;
-		}
-
-		list_del(&chunk->list);
+		chunk_evict(blk, chunk);
 	} else {
 		chunk = list_first_entry(&blk->idle_blocks, struct chunk, list);
 		list_del(&chunk->list);
@@ -128,6 +208,78 @@ static struct chunk *get_chunk(struct block_device *blk)
 	return chunk;
 }
 
+/*
+ * Maximum number of chunks read at once during readahead. We never use
+ * more than half of the cache so that readahead does not evict the whole
+ * working set.
+ */
+static int block_ra_chunks(struct block_device *blk)
+{
+	if (!blk->readahead)
+		return 0;
+
+	return min(blk->readahead + 1, blk->cache_chunks / 2);
+}
+
+/*
+ * Read the chunk starting at @start and the following chunks into the
+ * cache with a single request to the device. The data of the first
+ * ra_chunks chunks is contiguous in ra_buf, so these chunks are taken
+ * out of the cache and the device reads directly into them. Returns the
+ * number of chunks read or a negative error code. 0 is returned when
+ * readahead is not possible because the following chunk is already cached.
+ */
+static int block_readahead_chunks(struct block_device *blk, int start)
+{
+	struct chunk *chunk;
+	size_t num_blocks;
+	int i, n, ret;
+
+	for (i = 1; i < blk->ra_chunks; i++) {
+		int block = start + i * blk->rdbufsize;
+
+		if (block >= blk->num_blocks || chunk_lookup(blk, block))
+			break;
+	}
+
+	n = i;
+	if (n < 2)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		chunk = &blk->chunks[i];
+
+		if (RB_EMPTY_NODE(&chunk->node)) {
+			list_del(&chunk->list);
+		} else {
+			chunk_evict(blk, chunk);
+		}
+	}
+
+	num_blocks = min(n * blk->rdbufsize, blk->num_blocks - start);
+
+	debug("%s: %zu blocks from %d\n", __func__, num_blocks, start);
+
+	ret = blk->ops->read(blk, blk->ra_buf, start, num_blocks);
+	if (ret) {
+		for (i = 0; i < n; i++)
+			list_add_tail(&blk->chunks[i].list, &blk->idle_blocks);
+		return ret;
+	}
+
+	/*
+	 * Add the chunks in reverse order so that the requested one
+	 * ends up as the most recently used.
+	 */
+	for (i = n - 1; i >= 0; i--) {
+		chunk = &blk->chunks[i];
+		chunk->block_start = start + i * blk->rdbufsize;
+		chunk_add_cached(blk, chunk);
+	}
+
+	return n;
+}
+
 /*
  * read a block into the cache. This assumes that the block is
  * not cached already. By definition block_get_cached() for
@@ -137,10 +289,27 @@ static int block_cache(struct block_device *blk, int block)
 {
 	struct chunk *chunk;
 	size_t num_blocks;
+	int start = block & ~blk->blkmask;
 	int ret;
 
+	/*
+	 * A miss on the chunk directly following the previously filled
+	 * one indicates sequential access, so read ahead.
+	 */
+	if (blk->ra_chunks > 1 && start == blk->ra_next) {
+		ret = block_readahead_chunks(blk, start);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			blk->ra_next = start + ret * blk->rdbufsize;
+			return 0;
+		}
+	}
+
+	blk->ra_next = start + blk->rdbufsize;
+
 	chunk = get_chunk(blk);
-	chunk->block_start = block & ~blk->blkmask;
+	chunk->block_start = start;
 
 	debug("%s: %d to %d\n", __func__, chunk->block_start,
 			chunk->num);
@@ -152,7 +321,7 @@ static int block_cache(struct block_device *blk, int block)
 		list_add_tail(&chunk->list, &blk->idle_blocks);
 		return ret;
 	}
-	list_add(&chunk->list, &blk->buffered_blocks);
+	chunk_add_cached(blk, chunk);
 
 	return 0;
 }
@@ -184,6 +353,85 @@ static void *block_get(struct block_device *blk, int block)
 	return outdata;
 }
 
+/*
+ * Return the number of consecutive blocks starting at @block (at most
+ * @num_blocks) which are not in the cache. The caller must make sure
+ * that @block itself is not cached.
+ */
+static int block_uncached_run(struct block_device *blk, int block,
+		int num_blocks)
+{
+	struct rb_node *n = blk->chunk_tree.rb_node;
+	int end;
+
+	end = min(block + num_blocks, blk->num_blocks);
+
+	/* find the first cached chunk behind block */
+	while (n) {
+		struct chunk *chunk = rb_entry(n, struct chunk, node);
+
+		if (chunk->block_start > block) {
+			end = min(end, chunk->block_start);
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+
+	return end - block;
+}
+
+/*
+ * Read whole blocks into @buf. Runs of uncached blocks which are at least
+ * a chunk in size are read directly from the device into the callers
+ * buffer, bypassing the cache. Cached blocks are always taken from the
+ * cache as they may contain data not yet written back to the device.
+ * Buffers not suitable for DMA go through the cache which then acts as
+ * bounce buffer.
+ */
+static int block_read_blocks(struct block_device *blk, void *buf, int block,
+		int num_blocks)
+{
+	int ret;
+
+	while (num_blocks) {
+		void *iobuf = block_get_cached(blk, block);
+
+		if (!iobuf && dma_buf_is_aligned(buf)) {
+			int run = block_uncached_run(blk, block, num_blocks);
+
+			if (run >= blk->rdbufsize) {
+				run = min(run, BLOCK_MAX_DIRECT_BLOCKS);
+
+				debug("%s: direct read %d blocks from %d\n",
+						__func__, run, block);
+
+				ret = blk->ops->read(blk, buf, block, run);
+				if (ret)
+					return ret;
+
+				buf += run << blk->blockbits;
+				block += run;
+				num_blocks -= run;
+				continue;
+			}
+		}
+
+		if (!iobuf) {
+			iobuf = block_get(blk, block);
+			if (IS_ERR(iobuf))
+				return PTR_ERR(iobuf);
+		}
+
+		memcpy(buf, iobuf, BLOCKSIZE(blk));
+		buf += BLOCKSIZE(blk);
+		block++;
+		num_blocks--;
+	}
+
+	return 0;
+}
+
 static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 		loff_t offset, unsigned long flags)
 {
@@ -210,17 +458,15 @@ static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 
 	blocks = count >> blk->blockbits;
 
-	while (blocks) {
-		void *iobuf = block_get(blk, block);
+	if (blocks) {
+		int ret = block_read_blocks(blk, buf, block, blocks);
 
-		if (IS_ERR(iobuf))
-			return PTR_ERR(iobuf);
+		if (ret)
+			return ret;
 
-		memcpy(buf, iobuf, BLOCKSIZE(blk));
-		buf += BLOCKSIZE(blk);
-		blocks--;
-		block++;
-		count -= BLOCKSIZE(blk);
+		buf += blocks << blk->blockbits;
+		block += blocks;
+		count -= blocks << blk->blockbits;
 	}
 
 	if (count) {
@@ -342,31 +588,174 @@ static struct cdev_operations block_ops = {
 	.lseek	= dev_lseek_default,
 };
 
-int blockdevice_register(struct block_device *blk)
+static void block_cache_free(struct block_device *blk)
 {
-	loff_t size = (loff_t)blk->num_blocks * BLOCKSIZE(blk);
-	int ret;
 	int i;
 
-	blk->cdev.size = size;
-	blk->cdev.dev = blk->dev;
-	blk->cdev.ops = &block_ops;
-	blk->cdev.priv = blk;
-	blk->rdbufsize = BUFSIZE >> blk->blockbits;
+	for (i = blk->ra_chunks; i < blk->cache_chunks; i++)
+		dma_free(blk->chunks[i].data);
+
+	dma_free(blk->ra_buf);
+	blk->ra_buf = NULL;
+
+	free(blk->chunks);
+	blk->chunks = NULL;
+}
+
+/*
+ * (Re)allocate the cache according to the current cache_chunks,
+ * cache_chunksize and readahead settings. The cache must be flushed
+ * and freed before calling this.
+ */
+static void block_cache_alloc(struct block_device *blk)
+{
+	int i;
+
+	blk->rdbufsize = blk->cache_chunksize >> blk->blockbits;
+	blk->blkmask = blk->rdbufsize - 1;
+	blk->ra_next = -1;
+	blk->ra_chunks = block_ra_chunks(blk);
+	if (blk->ra_chunks < 2)
+		blk->ra_chunks = 0;
 
 	INIT_LIST_HEAD(&blk->buffered_blocks);
 	INIT_LIST_HEAD(&blk->idle_blocks);
-	blk->blkmask = blk->rdbufsize - 1;
+	blk->chunk_tree = RB_ROOT;
 
 	debug("%s: rdbufsize: %d blockbits: %d blkmask: 0x%08x\n", __func__, blk->rdbufsize, blk->blockbits,
 			blk->blkmask);
 
-	for (i = 0; i < 8; i++) {
-		struct chunk *chunk = xzalloc(sizeof(*chunk));
-		chunk->data = dma_alloc(BUFSIZE);
+	blk->chunks = xzalloc(blk->cache_chunks * sizeof(*blk->chunks));
+
+	if (blk->ra_chunks)
+		blk->ra_buf = dma_alloc(blk->ra_chunks * blk->cache_chunksize);
+
+	for (i = 0; i < blk->cache_chunks; i++) {
+		struct chunk *chunk = &blk->chunks[i];
+
+		if (i < blk->ra_chunks)
+			chunk->data = blk->ra_buf + i * blk->cache_chunksize;
+		else
+			chunk->data = dma_alloc(blk->cache_chunksize);
 		chunk->num = i;
+		RB_CLEAR_NODE(&chunk->node);
 		list_add_tail(&chunk->list, &blk->idle_blocks);
 	}
+}
+
+static int block_cache_check(struct block_device *blk)
+{
+	if (blk->cache_chunks < 2)
+		return -EINVAL;
+
+	if (!is_power_of_2(blk->cache_chunksize) ||
+	    blk->cache_chunksize < BLOCKSIZE(blk))
+		return -EINVAL;
+
+	if (blk->readahead < 0)
+		return -EINVAL;
+
+	if ((u64)blk->cache_chunks * blk->cache_chunksize > BLOCK_CACHE_MAX)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * The cache parameters are registered once per device, but a device may
+ * have multiple block devices, like the hardware partitions of a MMC card.
+ * Apply the new settings to all of them.
+ */
+static int block_cache_param_set(struct param_d *p, void *priv)
+{
+	struct block_device *blk = priv, *b;
+	int ret;
+
+	ret = block_cache_check(blk);
+	if (ret)
+		return ret;
+
+	for_each_block_device(b) {
+		if (b->dev != blk->dev)
+			continue;
+
+		ret = writebuffer_flush(b);
+		if (ret)
+			return ret;
+
+		block_cache_free(b);
+
+		b->cache_chunks = blk->cache_chunks;
+		b->cache_chunksize = blk->cache_chunksize;
+		b->readahead = blk->readahead;
+
+		block_cache_alloc(b);
+	}
+
+	return 0;
+}
+
+static const char * const block_cache_params[] = {
+	"cache_chunks", "cache_chunksize", "readahead",
+};
+
+static void block_cache_register_params(struct block_device *blk)
+{
+	struct block_device *b;
+
+	if (!blk->dev)
+		return;
+
+	for_each_block_device(b)
+		if (b != blk && b->dev == blk->dev)
+			return;
+
+	dev_add_param_int(blk->dev, block_cache_params[0], block_cache_param_set,
+			NULL, &blk->cache_chunks, "%d", blk);
+	dev_add_param_int(blk->dev, block_cache_params[1], block_cache_param_set,
+			NULL, &blk->cache_chunksize, "%d", blk);
+	dev_add_param_int(blk->dev, block_cache_params[2], block_cache_param_set,
+			NULL, &blk->readahead, "%d", blk);
+}
+
+static void block_cache_unregister_params(struct block_device *blk)
+{
+	struct param_d *p;
+	int i;
+
+	if (!blk->dev)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(block_cache_params); i++) {
+		p = get_param_by_name(blk->dev, block_cache_params[i]);
+		if (p && p->driver_priv == blk)
+			dev_remove_param(p);
+	}
+}
+
+int blockdevice_register(struct block_device *blk)
+{
+	loff_t size = (loff_t)blk->num_blocks * BLOCKSIZE(blk);
+	int ret;
+
+	blk->cdev.size = size;
+	blk->cdev.dev = blk->dev;
+	blk->cdev.ops = &block_ops;
+	blk->cdev.priv = blk;
+
+	blk->cache_chunks = block_cache_chunks;
+	blk->cache_chunksize = block_cache_chunksize;
+	blk->readahead = block_readahead;
+
+	if (block_cache_check(blk)) {
+		pr_warn("%s: invalid block cache settings, using defaults\n",
+			blk->cdev.name);
+		blk->cache_chunks = 8;
+		blk->cache_chunksize = max_t(int, PAGE_SIZE * 16, BLOCKSIZE(blk));
+		blk->readahead = 0;
+	}
+
+	block_cache_alloc(blk);
 
 	ret = devfs_create(&blk->cdev);
 	if (ret)
@@ -374,6 +763,8 @@ int blockdevice_register(struct block_device *blk)
 
 	list_add_tail(&blk->list, &block_device_list);
 
+	block_cache_register_params(blk);
+
 	cdev_create_default_automount(&blk->cdev);
 
 	return 0;
@@ -381,19 +772,10 @@ int blockdevice_register(struct block_device *blk)
 
 int blockdevice_unregister(struct block_device *blk)
 {
-	struct chunk *chunk, *tmp;
-
 	writebuffer_flush(blk);
 
-	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
-
-	list_for_each_entry_safe(chunk, tmp, &blk->idle_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
+	block_cache_unregister_params(blk);
+	block_cache_free(blk);
 
 	devfs_remove(&blk->cdev);
 	list_del(&blk->list);
@@ -422,3 +804,20 @@ int block_write(struct block_device *blk, void *buf, int block, int num_blocks)
 
 	return ret < 0 ? ret : 0;
 }
+
+static int block_init_globalvars(void)
+{
+	globalvar_add_simple_int("blockcache.chunks", &block_cache_chunks, "%d");
+	globalvar_add_simple_int("blockcache.chunksize", &block_cache_chunksize, "%d");
+	globalvar_add_simple_int("blockcache.readahead", &block_readahead, "%d");
+
+	return 0;
+}
+postcore_initcall(block_init_globalvars);
+
+BAREBOX_MAGICVAR_NAMED(global_blockcache_chunks, global.blockcache.chunks,
+		"Number of cache chunks for newly registered block devices");
+BAREBOX_MAGICVAR_NAMED(global_blockcache_chunksize, global.blockcache.chunksize,
+		"Size of a cache chunk in bytes for newly registered block devices");
+BAREBOX_MAGICVAR_NAMED(global_blockcache_readahead, global.blockcache.readahead,
+		"Number of chunks to read ahead on sequential access");
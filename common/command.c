@@ -34,6 +34,15 @@
 LIST_HEAD(command_list);
 EXPORT_SYMBOL(command_list);
 
+/*
+ * Sorted array of the commands in command_list used by find_cmd() to
+ * binary search a command. It is rebuilt on the next lookup after a
+ * command has been registered.
+ */
+static struct command **command_index;
+static int command_index_num;
+static bool command_index_valid;
+
 void barebox_cmd_usage(struct command *cmdtp)
 {
 	putchar('\n');
@@ -102,6 +111,7 @@ int register_command(struct command *cmd)
 	debug("register command %s\n", cmd->name);
 
 	list_add_sort(&cmd->list, &command_list, compare);
+	command_index_valid = false;
 
 	if (cmd->aliases) {
 		const char * const *aliases = cmd->aliases;
@@ -126,16 +136,53 @@ int register_command(struct command *cmd)
 }
 EXPORT_SYMBOL(register_command);
 
+static void command_index_update(void)
+{
+	struct command *cmdtp;
+	int n = 0;
+
+	for_each_command(cmdtp)
+		n++;
+
+	if (n > command_index_num) {
+		free(command_index);
+		command_index = xmalloc(n * sizeof(*command_index));
+	}
+
+	command_index_num = 0;
+	for_each_command(cmdtp)
+		command_index[command_index_num++] = cmdtp;
+
+	command_index_valid = true;
+}
+
 /*
  * find command table entry for a command
  */
 struct command *find_cmd (const char *cmd)
 {
-	struct command *cmdtp;
+	int lo = 0, hi, mid, ret;
 
-	for_each_command(cmdtp)
-		if (!strcmp(cmd, cmdtp->name))
-			return cmdtp;
+	if (!command_index_valid)
+		command_index_update();
+
+	hi = command_index_num;
+
+	/*
+	 * Find the first matching entry. When a command has been registered
+	 * multiple times the one registered last comes first in the list.
+	 */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		ret = strcmp(command_index[mid]->name, cmd);
+		if (ret < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < command_index_num && !strcmp(command_index[lo]->name, cmd))
+		return command_index[lo];
 
 	return NULL;	/* not found or ambiguous command */
 }
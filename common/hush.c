@@ -257,6 +257,7 @@ struct in_str {
 	const char *p;
 	int interrupt;
 	int promptmode;
+	int args_used;		/* positional parameters were expanded */
 	int (*get) (struct in_str *);
 	int (*peek) (struct in_str *);
 };
@@ -523,6 +524,7 @@ static void setup_file_in_str(struct in_str *i)
 	i->get = file_get;
 	i->interrupt = 0;
 	i->promptmode = 1;
+	i->args_used = 0;
 	i->p = NULL;
 }
 
@@ -532,6 +534,7 @@ static void setup_string_in_str(struct in_str *i, const char *s)
 	i->get = static_get;
 	i->interrupt = 0;
 	i->promptmode = 1;
+	i->args_used = 0;
 	i->p = s;
 }
 
@@ -737,6 +740,7 @@ static int run_pipe_real(struct p_context *ctx, struct pipe *pi)
 	glob_t globbuf = {};
 	int ret;
 	int rcode;
+	int sp;
 # if __GNUC__
 	/* Avoid longjmp clobbering */
 	(void) &i;
@@ -799,6 +803,12 @@ static int run_pipe_real(struct p_context *ctx, struct pipe *pi)
 		}
 		return EXIT_SUCCESS;   /* don't worry about errors in set_local_var() yet */
 	}
+	/*
+	 * Do not modify the pipe here, it may be run again when it
+	 * comes from a cached script.
+	 */
+	sp = child->sp;
+
 	for (i = 0; is_assignment(child->argv[i]); i++) {
 		p = insert_var_value(child->argv[i]);
 		rcode = set_local_var(p, 0);
@@ -806,11 +816,11 @@ static int run_pipe_real(struct p_context *ctx, struct pipe *pi)
 			return 1;
 
 		if (p != child->argv[i]) {
-			child->sp--;
+			sp--;
 			free(p);
 		}
 	}
-	if (child->sp) {
+	if (sp) {
 		char * str = NULL;
 		struct p_context ctx1;
 
@@ -851,6 +861,7 @@ static int run_list_real(struct p_context *ctx, struct pipe *pi)
 	char *save_name = NULL;
 	char **list = NULL;
 	char **save_list = NULL;
+	struct pipe *for_pipe = NULL;
 	struct pipe *rpipe;
 	int flag_rep = 0;
 	int rcode=0, flag_skip=1;
@@ -879,8 +890,10 @@ static int run_list_real(struct p_context *ctx, struct pipe *pi)
 		if (pi->r_mode == RES_WHILE || pi->r_mode == RES_UNTIL ||
 				pi->r_mode == RES_FOR) {
 			/* check Ctrl-C */
-			if (ctrlc())
-				return 1;
+			if (ctrlc()) {
+				rcode = 1;
+				break;
+			}
 			flag_restore = 0;
 			if (!rpipe) {
 				flag_rep = 0;
@@ -922,6 +935,7 @@ static int run_list_real(struct p_context *ctx, struct pipe *pi)
 					pi->progs->argv[0]);
 				save_list = list;
 				save_name = pi->progs->argv[0];
+				for_pipe = pi;
 				pi->progs->argv[0] = NULL;
 				flag_rep = 1;
 			}
@@ -963,7 +977,7 @@ static int run_list_real(struct p_context *ctx, struct pipe *pi)
 
 		if (rcode < -1) {
 			last_return_code = -rcode - 2;
-			return rcode;	/* exit */
+			break;	/* exit */
 		}
 
 		last_return_code = rcode;
@@ -981,6 +995,16 @@ static int run_list_real(struct p_context *ctx, struct pipe *pi)
 		     (rcode != EXIT_SUCCESS && pi->followup == PIPE_AND) )
 			skip_more_in_this_rmode = rmode;
 	}
+
+	if (list) {
+		/* left in the middle of a "for" loop, restore its variable */
+		while (*list)
+			free(*list++);
+		free(for_pipe->progs->argv[0]);
+		free(save_list);
+		for_pipe->progs->argv[0] = save_name;
+	}
+
 	return rcode;
 }
 
@@ -1421,6 +1445,7 @@ static int handle_dollar(o_string *dest, struct p_context *ctx, struct in_str *i
 	} else if (isdigit(ch)) {
 
 		i = ch - '0';	/* XXX is $0 special? */
+		input->args_used = 1;
 		if (i < ctx->global_argc) {
 			parse_string(dest, ctx, ctx->global_argv[i]);        /* recursion */
 		}
@@ -1436,6 +1461,7 @@ static int handle_dollar(o_string *dest, struct p_context *ctx, struct in_str *i
 			advance = 1;
 			break;
 		case '#':
+			input->args_used = 1;
 			b_adduint(dest,ctx->global_argc ? ctx->global_argc-1 : 0);
 			advance = 1;
 			break;
@@ -1456,6 +1482,7 @@ static int handle_dollar(o_string *dest, struct p_context *ctx, struct in_str *i
 			b_addchr(dest, SPECIAL_VAR_SYMBOL);
 			break;
 		case '*':
+			input->args_used = 1;
 			for (i = 1; i < ctx->global_argc; i++) {
 				b_addstr(dest, ctx->global_argv[i]);
 				b_addchr(dest, ' ');
@@ -1676,56 +1703,70 @@ char *shell_expand(char *str)
 	return res;
 }
 
+/*
+ * Parse the next top level command list from inp into ctx->list_head.
+ * Returns 0 when a list has been parsed, -1 when the last list before the
+ * end of input has been parsed and 1 on syntax errors. The list may be
+ * empty.
+ */
+static int parse_stream_list(struct p_context *ctx, struct in_str *inp, int flag)
+{
+	o_string temp = NULL_O_STRING;
+	int rcode;
+
+	ctx->type = flag;
+	initialize_context(ctx);
+	update_ifs_map();
+
+	if (!(flag & FLAG_PARSE_SEMICOLON) || (flag & FLAG_REPARSING))
+		mapset((uchar *)";$&|", 0);
+
+	inp->promptmode = 1;
+	rcode = parse_stream(&temp, ctx, inp, '\n');
+
+	if (rcode != 1 && ctx->old_flag != 0) {
+		syntax();
+		b_free(&temp);
+		return 1;
+	}
+
+	if (rcode != 1) {
+		done_word(&temp, ctx);
+		done_pipe(ctx, PIPE_SEQ);
+	} else {
+		if (ctx->old_flag != 0)
+			free(ctx->stack);
+		free_pipe_list(ctx->list_head, 0);
+	}
+
+	b_free(&temp);
+
+	return rcode;
+}
+
 /* most recursion does not come through here, the exeception is
  * from builtin_source() */
 static int parse_stream_outer(struct p_context *ctx, struct in_str *inp, int flag)
 {
-	o_string temp = NULL_O_STRING;
 	int rcode;
 	int code = 0;
 
 	do {
-		ctx->type = flag;
-		initialize_context(ctx);
-		update_ifs_map();
-
-		if (!(flag & FLAG_PARSE_SEMICOLON) || (flag & FLAG_REPARSING))
-			mapset((uchar *)";$&|", 0);
-
-		inp->promptmode = 1;
-		rcode = parse_stream(&temp, ctx, inp, '\n');
-
-		if (rcode != 1 && ctx->old_flag != 0) {
-			syntax();
-			return 1;
-		}
-		if (rcode != 1 && ctx->old_flag == 0) {
-			done_word(&temp, ctx);
-			done_pipe(ctx, PIPE_SEQ);
-			if (ctx->list_head->num_progs) {
-				code = run_list(ctx, ctx->list_head);
-			} else {
-				free_pipe_list(ctx->list_head, 0);
-				continue;
-			}
-			if (code < -1) {	/* exit */
-				b_free(&temp);
-				return code;
-			}
-		} else {
-			if (ctx->old_flag != 0) {
-				free(ctx->stack);
-				b_reset(&temp);
-			}
+		rcode = parse_stream_list(ctx, inp, flag);
+		if (rcode == 1) {
 			if (inp->interrupt)
 				printf("<INTERRUPT>\n");
-			temp.nonnull = 0;
-			temp.quote = 0;
-			free_pipe_list(ctx->list_head,0);
-			b_free(&temp);
 			return 1;
 		}
-		b_free(&temp);
+
+		if (!ctx->list_head->num_progs) {
+			free_pipe_list(ctx->list_head, 0);
+			continue;
+		}
+
+		code = run_list(ctx, ctx->list_head);
+		if (code < -1)	/* exit */
+			return code;
 	} while (rcode != -1 && !(flag & FLAG_EXIT_FROM_LOOP));   /* loop on syntax errors, return on EOF */
 
 	return code;
@@ -1887,10 +1928,198 @@ static int execute_script(const char *path, int argc, char *argv[])
 	return ret;
 }
 
+/*
+ * Cache for the parsed command lists of scripts, so that scripts which are
+ * executed multiple times are only parsed once. The filesystems do not
+ * maintain modification times, so a cached script is validated against
+ * the script contents instead.
+ *
+ * The script is parsed lazily while executing it, so that a script which
+ * exits early or has a syntax error further down behaves the same as
+ * without the cache. Positional parameters are substituted during parsing,
+ * so scripts using them are not kept in the cache.
+ *
+ * At most SCRIPT_CACHE_MAX scripts are cached, the least recently used
+ * ones are dropped first.
+ */
+#define SCRIPT_CACHE_MAX	32
+
+struct script_cache {
+	struct list_head list;
+	char *path;
+	char *script;		/* script contents, newline terminated */
+	size_t size;		/* size of the script file */
+	const char *parse_pos;	/* where to continue parsing, NULL when done */
+	struct pipe **lists;	/* top level command lists parsed so far */
+	int num_lists;
+	int users;
+	int stale;		/* free when the last user is gone */
+};
+
+static LIST_HEAD(script_cache_list);
+static int script_cache_num;
+
+static void script_cache_free(struct script_cache *sc)
+{
+	int i;
+
+	for (i = 0; i < sc->num_lists; i++)
+		free_pipe_list(sc->lists[i], 0);
+
+	list_del(&sc->list);
+	free(sc->lists);
+	free(sc->script);
+	free(sc->path);
+	free(sc);
+
+	script_cache_num--;
+}
+
+/*
+ * Make room for a new entry. Scripts currently being executed, like the
+ * callers of a nested script, are kept.
+ */
+static void script_cache_shrink(void)
+{
+	struct script_cache *sc, *tmp;
+
+	list_for_each_entry_safe_reverse(sc, tmp, &script_cache_list, list) {
+		if (script_cache_num < SCRIPT_CACHE_MAX)
+			break;
+
+		if (!sc->users)
+			script_cache_free(sc);
+	}
+}
+
+/*
+ * Find the cache entry for a script or create a new one. Takes the
+ * ownership of the script buffer.
+ */
+static struct script_cache *script_cache_get(const char *path, char *script,
+					     size_t size)
+{
+	struct script_cache *sc, *tmp;
+
+	list_for_each_entry_safe(sc, tmp, &script_cache_list, list) {
+		if (sc->stale || strcmp(sc->path, path))
+			continue;
+
+		if (sc->size == size && !memcmp(sc->script, script, size)) {
+			free(script);
+			list_move(&sc->list, &script_cache_list);
+			goto out;
+		}
+
+		if (sc->users)
+			sc->stale = 1;
+		else
+			script_cache_free(sc);
+		break;
+	}
+
+	script_cache_shrink();
+
+	sc = xzalloc(sizeof(*sc));
+	sc->path = xstrdup(path);
+	sc->script = xrealloc(script, size + 2);
+	sc->script[size] = '\n';
+	sc->script[size + 1] = 0;
+	sc->size = size;
+	sc->parse_pos = sc->script;
+	list_add(&sc->list, &script_cache_list);
+	script_cache_num++;
+out:
+	sc->users++;
+
+	return sc;
+}
+
+static void script_cache_put(struct script_cache *sc)
+{
+	sc->users--;
+
+	if (sc->stale && !sc->users)
+		script_cache_free(sc);
+}
+
+/*
+ * Parse the next non empty command list of a cached script. Returns 0 when
+ * a list has been added or the end of the script has been reached, 1 on
+ * syntax errors.
+ */
+static int script_cache_parse(struct p_context *ctx, struct script_cache *sc)
+{
+	struct p_context pctx = {};
+	struct in_str input;
+	int rcode;
+
+	/* positional parameters may have been shifted by getopt */
+	pctx.global_argc = ctx->global_argc;
+	pctx.global_argv = ctx->global_argv;
+
+	setup_string_in_str(&input, sc->parse_pos);
+
+	do {
+		rcode = parse_stream_list(&pctx, &input, FLAG_PARSE_SEMICOLON);
+		if (rcode == 1)
+			return 1;
+
+		if (pctx.list_head->num_progs) {
+			sc->lists = xrealloc(sc->lists,
+					(sc->num_lists + 1) * sizeof(*sc->lists));
+			sc->lists[sc->num_lists++] = pctx.list_head;
+			break;
+		}
+
+		free_pipe_list(pctx.list_head, 0);
+	} while (rcode != -1);
+
+	sc->parse_pos = rcode == -1 ? NULL : input.p;
+
+	if (input.args_used)
+		sc->stale = 1;
+
+	return 0;
+}
+
+static int run_script_cached(struct p_context *ctx, const char *path,
+			     char *script, size_t size)
+{
+	struct script_cache *sc;
+	int i, ret = 0;
+
+	sc = script_cache_get(path, script, size);
+
+	for (i = 0; ; i++) {
+		if (i == sc->num_lists) {
+			if (!sc->parse_pos)
+				break;
+
+			if (script_cache_parse(ctx, sc)) {
+				ret = 1;
+				break;
+			}
+
+			if (i == sc->num_lists)
+				break;
+		}
+
+		ret = run_list_real(ctx, sc->lists[i]);
+		if (ret < -1)	/* exit */
+			break;
+	}
+
+	script_cache_put(sc);
+
+	return ret;
+}
+
 static int source_script(const char *path, int argc, char *argv[])
 {
 	struct p_context ctx = {};
 	char *script;
+	size_t size;
 	int ret;
 
 	initialize_context(&ctx);
@@ -1898,18 +2127,23 @@ static int source_script(const char *path, int argc, char *argv[])
 	ctx.global_argc = argc;
 	ctx.global_argv = argv;
 
-	script = read_file(path, NULL);
+	script = read_file(path, &size);
 	if (!script) {
 		perror("sh");
 		return 1;
 	}
 
-	ret = parse_string_outer(&ctx, script, FLAG_PARSE_SEMICOLON);
+	if (IS_ENABLED(CONFIG_HUSH_SCRIPT_CACHE)) {
+		ret = run_script_cached(&ctx, path, script, size);
+	} else {
+		ret = parse_string_outer(&ctx, script, FLAG_PARSE_SEMICOLON);
+		free(script);
+	}
+
 	if (ret < -1)
 		ret = -ret - 2;
 
 	release_context(&ctx);
-	free(script);
 
 	return ret;
 }
@@ -28,6 +28,7 @@
 #include <fs.h>
 #include <malloc.h>
 #include <linux/ctype.h>
+#include <linux/sizes.h>
 #include <asm/byteorder.h>
 #include <errno.h>
 #include <linux/err.h>
@@ -43,6 +44,9 @@
 #define CHECK_LEVEL_SIG 2
 #define CHECK_LEVEL_MAX 3
 
+#define FIT_STREAM_BUFSIZE	SZ_4K
+#define FIT_STREAM_CHUNK	SZ_1M
+
 static uint32_t dt_struct_advance(struct fdt_header *f, uint32_t dt, int size)
 {
 	dt += size;
@@ -371,13 +375,24 @@ static int fit_verify_signature(struct device_node *sig_node, const void *fit)
 	return ret;
 }
 
-static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
-			   const void *data, int data_len)
+/*
+ * State for verifying an image's data. Depending on whether the image is
+ * opened as part of a configuration either the hash or the RSA signature
+ * of the image is checked. The data can be fed in multiple pieces, so that
+ * it can be verified while it is read from the medium.
+ */
+struct fit_image_digest {
+	struct device_node *node;
+	struct digest *digest;
+	enum hash_algo algo;
+	bool signature;
+};
+
+static int fit_hash_start(struct fit_handle *handle, struct device_node *image,
+			  struct fit_image_digest *id)
 {
 	struct digest *d;
 	const char *algo;
-	const char *value_read;
-	char *value_calc;
 	int hash_len, ret;
 	struct device_node *hash;
 
@@ -399,8 +414,7 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 		return ret;
 	}
 
-	value_read = of_get_property(hash, "value", &hash_len);
-	if (!value_read) {
+	if (!of_get_property(hash, "value", &hash_len)) {
 		pr_err("%s: \"value\" property not found\n", hash->full_name);
 		return -EINVAL;
 	}
@@ -418,40 +432,48 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 
 	if (hash_len != digest_length(d)) {
 		pr_err("%s: invalid hash length %d\n", hash->full_name, hash_len);
-		ret = -EINVAL;
-		goto err_digest_free;
+		digest_free(d);
+		return -EINVAL;
 	}
 
+	digest_init(d);
+
+	id->node = hash;
+	id->digest = d;
+
+	return 0;
+}
+
+static int fit_hash_finish(struct fit_image_digest *id)
+{
+	const char *value_read;
+	char *value_calc;
+	int hash_len, ret;
+
+	value_read = of_get_property(id->node, "value", &hash_len);
 	value_calc = xmalloc(hash_len);
 
-	digest_init(d);
-	digest_update(d, data, data_len);
-	digest_final(d, value_calc);
+	digest_final(id->digest, value_calc);
 
 	if (memcmp(value_read, value_calc, hash_len)) {
-		pr_info("%s: hash BAD\n", hash->full_name);
+		pr_info("%s: hash BAD\n", id->node->full_name);
 		ret =  -EBADMSG;
 	} else {
-		pr_info("%s: hash OK\n", hash->full_name);
+		pr_info("%s: hash OK\n", id->node->full_name);
 		ret = 0;
 	}
 
 	free(value_calc);
 
-err_digest_free:
-	digest_free(d);
-
 	return ret;
 }
 
-static int fit_image_verify_signature(struct fit_handle *handle,
-				      struct device_node *image,
-				      const void *data, int data_len)
+static int fit_image_signature_start(struct fit_handle *handle,
+				     struct device_node *image,
+				     struct fit_image_digest *id)
 {
 	struct digest *digest;
 	struct device_node *sig_node;
-	enum hash_algo algo = 0;
-	void *hash;
 	int ret;
 
 	if (!IS_ENABLED(CONFIG_FITIMAGE_SIGNATURE))
@@ -473,23 +495,77 @@ static int fit_image_verify_signature(struct fit_handle *handle,
 		return ret;
 	}
 
-	digest = fit_alloc_digest(sig_node, &algo);
+	digest = fit_alloc_digest(sig_node, &id->algo);
 	if (IS_ERR(digest))
 		return PTR_ERR(digest);
 
-	digest_update(digest, data, data_len);
-	hash = xzalloc(digest_length(digest));
-	digest_final(digest, hash);
+	id->node = sig_node;
+	id->digest = digest;
+	id->signature = true;
 
-	ret = fit_check_rsa_signature(sig_node, algo, hash);
+	return 0;
+}
+
+static int fit_image_signature_finish(struct fit_image_digest *id)
+{
+	void *hash;
+	int ret;
+
+	hash = xzalloc(digest_length(id->digest));
+	digest_final(id->digest, hash);
+
+	ret = fit_check_rsa_signature(id->node, id->algo, hash);
 
 	free(hash);
 
-	digest_free(digest);
+	return ret;
+}
+
+static int fit_image_digest_start(struct fit_handle *handle,
+				  struct device_node *image,
+				  struct device_node *conf_node,
+				  struct fit_image_digest *id)
+{
+	memset(id, 0, sizeof(*id));
+
+	if (conf_node)
+		return fit_hash_start(handle, image, id);
+	else
+		return fit_image_signature_start(handle, image, id);
+}
+
+static void fit_image_digest_update(struct fit_image_digest *id,
+				    const void *data, unsigned long len)
+{
+	if (id->digest)
+		digest_update(id->digest, data, len);
+}
+
+static int fit_image_digest_finish(struct fit_image_digest *id)
+{
+	int ret;
+
+	if (!id->digest)
+		return 0;
+
+	if (IS_ENABLED(CONFIG_FITIMAGE_SIGNATURE) && id->signature)
+		ret = fit_image_signature_finish(id);
+	else
+		ret = fit_hash_finish(id);
+
+	digest_free(id->digest);
+	id->digest = NULL;
 
 	return ret;
 }
 
+static void fit_image_digest_abort(struct fit_image_digest *id)
+{
+	if (id->digest)
+		digest_free(id->digest);
+	id->digest = NULL;
+}
+
 int fit_has_image(struct fit_handle *handle, void *configuration,
 		  const char *name)
 {
@@ -505,6 +581,113 @@ int fit_has_image(struct fit_handle *handle, void *configuration,
 	return 1;
 }
 
+/*
+ * Image data which is not part of the in-memory FIT blob when the FIT image
+ * is opened in streaming mode. @buf is only allocated when the data is
+ * requested through fit_open_image().
+ */
+struct fit_data {
+	struct list_head list;
+	char *path;
+	struct device_node *node;
+	loff_t offset;
+	unsigned long size;
+	void *buf;
+};
+
+static struct fit_data *fit_find_data(struct fit_handle *handle,
+				      struct device_node *image)
+{
+	struct fit_data *fd;
+
+	list_for_each_entry(fd, &handle->data, list)
+		if (fd->node == image)
+			return fd;
+
+	return NULL;
+}
+
+/*
+ * Read streamed image data to @dest, feeding it into the image digest
+ * piece by piece while it is still hot in the cache. With @dest being
+ * NULL the data is only fed into the digest.
+ */
+static int fit_read_data(struct fit_handle *handle, struct fit_data *fd,
+			 void *dest, struct fit_image_digest *id)
+{
+	unsigned long pos = 0;
+	void *buf = NULL;
+	int ret = 0;
+
+	if (lseek(handle->fd, fd->offset, SEEK_SET) != fd->offset)
+		return -errno;
+
+	if (!dest)
+		buf = xmalloc(FIT_STREAM_CHUNK);
+
+	while (pos < fd->size) {
+		unsigned long now = min_t(unsigned long, fd->size - pos,
+					  FIT_STREAM_CHUNK);
+		void *p = dest ? dest + pos : buf;
+
+		ret = read_full(handle->fd, p, now);
+		if (ret < 0)
+			goto out;
+		if (ret < now) {
+			ret = -EIO;
+			goto out;
+		}
+
+		if (id)
+			fit_image_digest_update(id, p, now);
+
+		pos += now;
+	}
+
+	ret = 0;
+out:
+	free(buf);
+
+	return ret;
+}
+
+static struct device_node *fit_get_image(struct fit_handle *handle,
+					 struct device_node *conf_node,
+					 const char *name)
+{
+	struct device_node *image;
+	const char *unit, *type = NULL;
+
+	if (conf_node) {
+		if (of_property_read_string(conf_node, name, &unit)) {
+			pr_err("No image named '%s'\n", name);
+			return ERR_PTR(-ENOENT);
+		}
+	} else {
+		unit = name;
+	}
+
+	image = of_get_child_by_name(handle->images, unit);
+	if (!image)
+		return ERR_PTR(-ENOENT);
+
+	of_property_read_string(image, "type", &type);
+	if (!type) {
+		pr_err("No \"type\" property found in %s\n", image->full_name);
+		return ERR_PTR(-EINVAL);
+	}
+
+	return image;
+}
+
+static void fit_print_image(struct device_node *image)
+{
+	const char *desc = "(no description)";
+
+	of_property_read_string(image, "description", &desc);
+	pr_info("image '%s': '%s'\n", image->name, desc);
+}
+
 /**
  * fit_open_image - Open an image in a FIT image
  * @handle: The FIT image handle
@@ -527,52 +710,209 @@ int fit_open_image(struct fit_handle *handle, void *configuration,
 		   unsigned long *outsize)
 {
 	struct device_node *image;
-	const char *unit, *type = NULL, *desc= "(no description)";
+	struct fit_image_digest id;
+	struct fit_data *fd;
 	const void *data;
 	int data_len;
 	int ret = 0;
 	struct device_node *conf_node = configuration;
 
-	if (conf_node) {
-		if (of_property_read_string(conf_node, name, &unit)) {
-			pr_err("No image named '%s'\n", name);
-			return -ENOENT;
+	image = fit_get_image(handle, conf_node, name);
+	if (IS_ERR(image))
+		return PTR_ERR(image);
+
+	fit_print_image(image);
+
+	fd = fit_find_data(handle, image);
+	if (fd) {
+		if (!fd->buf) {
+			fd->buf = malloc(fd->size);
+			if (!fd->buf)
+				return -ENOMEM;
+
+			ret = fit_read_data(handle, fd, fd->buf, NULL);
+			if (ret) {
+				free(fd->buf);
+				fd->buf = NULL;
+				return ret;
+			}
 		}
+
+		data = fd->buf;
+		data_len = fd->size;
 	} else {
-		unit = name;
+		data = of_get_property(image, "data", &data_len);
+		if (!data) {
+			pr_err("data not found\n");
+			return -EINVAL;
+		}
 	}
 
-	image = of_get_child_by_name(handle->images, unit);
-	if (!image)
-		return -ENOENT;
+	ret = fit_image_digest_start(handle, image, conf_node, &id);
+	if (ret < 0)
+		return ret;
 
-	of_property_read_string(image, "description", &desc);
-	pr_info("image '%s': '%s'\n", unit, desc);
+	fit_image_digest_update(&id, data, data_len);
 
-	of_property_read_string(image, "type", &type);
-	if (!type) {
-		pr_err("No \"type\" property found in %s\n", image->full_name);
-		return -EINVAL;
+	ret = fit_image_digest_finish(&id);
+	if (ret < 0)
+		return ret;
+
+	*outdata = data;
+	*outsize = data_len;
+
+	return 0;
+}
+
+/**
+ * fit_get_image_size - Get the size of an image in a FIT image
+ * @handle: The FIT image handle
+ * @configuration: The configuration cookie or NULL, see fit_open_image()
+ * @name: The name of the image
+ * @outsize: Size of the image
+ *
+ * This can be used to find out how much space is needed to load an image
+ * with fit_load_image(). The image data is neither read nor verified.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int fit_get_image_size(struct fit_handle *handle, void *configuration,
+		       const char *name, unsigned long *outsize)
+{
+	struct device_node *image;
+	struct fit_data *fd;
+	int data_len;
+
+	image = fit_get_image(handle, configuration, name);
+	if (IS_ERR(image))
+		return PTR_ERR(image);
+
+	fd = fit_find_data(handle, image);
+	if (fd) {
+		*outsize = fd->size;
+		return 0;
 	}
 
-	data = of_get_property(image, "data", &data_len);
-	if (!data) {
+	if (!of_get_property(image, "data", &data_len)) {
 		pr_err("data not found\n");
 		return -EINVAL;
 	}
 
-	if (conf_node)
-		ret = fit_verify_hash(handle, image, data, data_len);
-	else
-		ret = fit_image_verify_signature(handle, image, data, data_len);
+	*outsize = data_len;
+
+	return 0;
+}
+
+/**
+ * fit_load_image - Load an image in a FIT image to a given address
+ * @handle: The FIT image handle
+ * @configuration: The configuration cookie or NULL, see fit_open_image()
+ * @name: The name of the image to load
+ * @dest: The buffer to load the image to
+ * @size: The size of @dest
+ *
+ * Like fit_open_image(), but the image is placed at @dest. When the FIT
+ * image is opened in streaming mode the data is read directly to @dest and
+ * verified while being read, so no intermediate copy of the image is made.
+ * On failure the content of @dest is undefined.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int fit_load_image(struct fit_handle *handle, void *configuration,
+		   const char *name, void *dest, unsigned long size)
+{
+	struct device_node *image;
+	struct fit_image_digest id;
+	struct fit_data *fd;
+	const void *data = NULL;
+	int data_len;
+	int ret;
+	struct device_node *conf_node = configuration;
+
+	image = fit_get_image(handle, conf_node, name);
+	if (IS_ERR(image))
+		return PTR_ERR(image);
 
+	fit_print_image(image);
+
+	fd = fit_find_data(handle, image);
+	if (fd && !fd->buf) {
+		data_len = fd->size;
+	} else if (fd) {
+		data = fd->buf;
+		data_len = fd->size;
+	} else {
+		data = of_get_property(image, "data", &data_len);
+		if (!data) {
+			pr_err("data not found\n");
+			return -EINVAL;
+		}
+	}
+
+	if (data_len > size)
+		return -ENOSPC;
+
+	ret = fit_image_digest_start(handle, image, conf_node, &id);
 	if (ret < 0)
 		return ret;
 
-	*outdata = data;
-	*outsize = data_len;
+	if (data) {
+		memcpy(dest, data, data_len);
+		fit_image_digest_update(&id, dest, data_len);
+	} else {
+		ret = fit_read_data(handle, fd, dest, &id);
+		if (ret) {
+			fit_image_digest_abort(&id);
+			return ret;
+		}
+	}
 
-	return 0;
+	return fit_image_digest_finish(&id);
+}
+
+/**
+ * fit_verify_image - Verify an image in a FIT image without loading it
+ * @handle: The FIT image handle
+ * @configuration: The configuration cookie or NULL, see fit_open_image()
+ * @name: The name of the image to verify
+ *
+ * Checks the hash or signature of an image like fit_load_image() does, but
+ * streamed image data is not kept in memory. This is for callers which do
+ * not load the image, like a bootm dryrun.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int fit_verify_image(struct fit_handle *handle, void *configuration,
+		     const char *name)
+{
+	struct device_node *image;
+	struct fit_image_digest id;
+	struct fit_data *fd;
+	const void *data;
+	unsigned long size;
+	int ret;
+
+	image = fit_get_image(handle, configuration, name);
+	if (IS_ERR(image))
+		return PTR_ERR(image);
+
+	fd = fit_find_data(handle, image);
+	if (!fd || fd->buf)
+		return fit_open_image(handle, configuration, name, &data, &size);
+
+	fit_print_image(image);
+
+	ret = fit_image_digest_start(handle, image, configuration, &id);
+	if (ret < 0)
+		return ret;
+
+	ret = fit_read_data(handle, fd, NULL, &id);
+	if (ret) {
+		fit_image_digest_abort(&id);
+		return ret;
+	}
+
+	return fit_image_digest_finish(&id);
 }
 
 static int fit_config_verify_signature(struct fit_handle *handle, struct device_node *conf_node)
@@ -690,10 +1030,307 @@ void *fit_open_configuration(struct fit_handle *handle, const char *name)
 	return conf_node;
 }
 
+struct fit_stream {
+	int fd;
+	loff_t bufstart;
+	size_t buflen;
+	char buf[FIT_STREAM_BUFSIZE];
+};
+
+/*
+ * Make the file content at @pos available in the stream buffer. Returns a
+ * pointer to it and the number of bytes available in @avail.
+ */
+static const void *fit_stream_peek(struct fit_stream *s, loff_t pos,
+				   size_t *avail)
+{
+	int ret;
+
+	if (pos < s->bufstart || pos >= s->bufstart + s->buflen) {
+		if (lseek(s->fd, pos, SEEK_SET) != pos)
+			return ERR_PTR(-errno);
+
+		ret = read_full(s->fd, s->buf, FIT_STREAM_BUFSIZE);
+		if (ret <= 0)
+			return ERR_PTR(ret ? ret : -EINVAL);
+
+		s->bufstart = pos;
+		s->buflen = ret;
+	}
+
+	*avail = s->bufstart + s->buflen - pos;
+
+	return s->buf + (pos - s->bufstart);
+}
+
+static int fit_stream_read(struct fit_stream *s, loff_t pos, void *dest,
+			   size_t len)
+{
+	const void *p;
+	size_t avail;
+	int ret;
+
+	if (len > FIT_STREAM_BUFSIZE) {
+		if (lseek(s->fd, pos, SEEK_SET) != pos)
+			return -errno;
+
+		ret = read_full(s->fd, dest, len);
+		if (ret < 0)
+			return ret;
+
+		return ret < len ? -EINVAL : 0;
+	}
+
+	p = fit_stream_peek(s, pos, &avail);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+
+	if (avail < len) {
+		/* refill the buffer starting at @pos */
+		s->buflen = 0;
+		p = fit_stream_peek(s, pos, &avail);
+		if (IS_ERR(p))
+			return PTR_ERR(p);
+		if (avail < len)
+			return -EINVAL;
+	}
+
+	memcpy(dest, p, len);
+
+	return 0;
+}
+
+static void *fit_skeleton_grow(void **skel, size_t *skel_size, size_t len)
+{
+	size_t ofs = *skel_size;
+
+	*skel_size += len;
+	*skel = xrealloc(*skel, *skel_size);
+
+	return *skel + ofs;
+}
+
+/*
+ * Build a copy of the FIT structure which lacks the (possibly huge) "data"
+ * properties of the images. The file offsets of these are recorded instead
+ * so that the data can be read later directly to where it is needed. The
+ * "data" properties are excluded from the signatures anyway, so the
+ * resulting blob can be verified just like the original one.
+ */
+static int fit_open_stream(struct fit_handle *handle)
+{
+	struct fit_stream *s;
+	struct fdt_header hdr, *fdt;
+	struct fit_data *fd;
+	void *skel = NULL, *strings = NULL;
+	size_t skel_size, struct_start;
+	uint32_t off_dt_struct, size_dt_struct, off_dt_strings, size_dt_strings;
+	uint32_t tag;
+	loff_t pos, end;
+	char path[FDT_MAX_PATH_LEN];
+	char *pend = path;
+	int depth = 0;
+	int ret;
+
+	s = xzalloc(sizeof(*s));
+	s->fd = handle->fd;
+
+	ret = fit_stream_read(s, 0, &hdr, sizeof(hdr));
+	if (ret)
+		goto out;
+
+	/* same version range as libfdt's fdt_check_header() */
+	if (fdt32_to_cpu(hdr.magic) != FDT_MAGIC ||
+	    fdt32_to_cpu(hdr.version) < FDT_FIRST_SUPPORTED_VERSION ||
+	    fdt32_to_cpu(hdr.last_comp_version) > FDT_LAST_SUPPORTED_VERSION) {
+		pr_err("bad FIT header\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	off_dt_struct = fdt32_to_cpu(hdr.off_dt_struct);
+
+	/* size_dt_struct is new in version 17 */
+	if (fdt32_to_cpu(hdr.version) >= 17)
+		size_dt_struct = fdt32_to_cpu(hdr.size_dt_struct);
+	else
+		size_dt_struct = fdt32_to_cpu(hdr.totalsize) - off_dt_struct;
+	off_dt_strings = fdt32_to_cpu(hdr.off_dt_strings);
+	size_dt_strings = fdt32_to_cpu(hdr.size_dt_strings);
+
+	strings = xmalloc(size_dt_strings);
+	ret = fit_stream_read(s, off_dt_strings, strings, size_dt_strings);
+	if (ret)
+		goto out;
+
+	/* header, followed by an empty memory reservation map */
+	skel_size = ALIGN(sizeof(hdr), 8) + sizeof(struct fdt_reserve_entry);
+	skel = xzalloc(skel_size);
+	struct_start = skel_size;
+
+	*pend = '\0';
+	pos = off_dt_struct;
+	end = (loff_t)off_dt_struct + size_dt_struct;
+
+	do {
+		struct fdt_property prop;
+		const char *name;
+		size_t avail;
+		void *p;
+		int len;
+
+		if (pos + FDT_TAGSIZE > end) {
+			ret = -ESPIPE;
+			goto out;
+		}
+
+		ret = fit_stream_read(s, pos, &tag, FDT_TAGSIZE);
+		if (ret)
+			goto out;
+
+		switch (fdt32_to_cpu(tag)) {
+		case FDT_BEGIN_NODE:
+			name = fit_stream_peek(s, pos + FDT_TAGSIZE, &avail);
+			if (IS_ERR(name)) {
+				ret = PTR_ERR(name);
+				goto out;
+			}
+
+			len = strnlen(name, avail);
+			if (len == avail) {
+				/* maybe crossing the buffer end, refill */
+				s->buflen = 0;
+				name = fit_stream_peek(s, pos + FDT_TAGSIZE, &avail);
+				if (IS_ERR(name)) {
+					ret = PTR_ERR(name);
+					goto out;
+				}
+				len = strnlen(name, avail);
+				if (len == avail) {
+					ret = -ESPIPE;
+					goto out;
+				}
+			}
+
+			if (++depth == FDT_MAX_DEPTH ||
+			    pend - path + 2 + len >= FDT_MAX_PATH_LEN) {
+				ret = -ESPIPE;
+				goto out;
+			}
+			if (pend != path + 1)
+				*pend++ = '/';
+			strcpy(pend, name);
+			pend += len;
+
+			p = fit_skeleton_grow(&skel, &skel_size,
+					      ALIGN(FDT_TAGSIZE + len + 1, 4));
+			memset(p, 0, ALIGN(FDT_TAGSIZE + len + 1, 4));
+			memcpy(p, &tag, FDT_TAGSIZE);
+			memcpy(p + FDT_TAGSIZE, name, len);
+
+			pos += ALIGN(FDT_TAGSIZE + len + 1, 4);
+
+			break;
+
+		case FDT_END_NODE:
+			if (!depth--) {
+				ret = -ESPIPE;
+				goto out;
+			}
+			while (pend > path && *--pend != '/')
+				;
+			*pend = '\0';
+
+			/* fall through */
+		case FDT_NOP:
+		case FDT_END:
+			p = fit_skeleton_grow(&skel, &skel_size, FDT_TAGSIZE);
+			memcpy(p, &tag, FDT_TAGSIZE);
+
+			pos += FDT_TAGSIZE;
+
+			break;
+
+		case FDT_PROP:
+			ret = fit_stream_read(s, pos, &prop, sizeof(prop));
+			if (ret)
+				goto out;
+
+			len = fdt32_to_cpu(prop.len);
+			if (len < 0 || fdt32_to_cpu(prop.nameoff) >= size_dt_strings ||
+			    pos + sizeof(prop) + len > end) {
+				ret = -ESPIPE;
+				goto out;
+			}
+
+			name = strings + fdt32_to_cpu(prop.nameoff);
+
+			if (!strcmp(name, "data")) {
+				fd = xzalloc(sizeof(*fd));
+				fd->path = xstrdup(path);
+				fd->offset = pos + sizeof(prop);
+				fd->size = len;
+				list_add_tail(&fd->list, &handle->data);
+			} else {
+				p = fit_skeleton_grow(&skel, &skel_size,
+						      ALIGN(sizeof(prop) + len, 4));
+				memset(p, 0, ALIGN(sizeof(prop) + len, 4));
+				memcpy(p, &prop, sizeof(prop));
+				ret = fit_stream_read(s, pos + sizeof(prop),
+						      p + sizeof(prop), len);
+				if (ret)
+					goto out;
+			}
+
+			pos += ALIGN(sizeof(prop) + len, 4);
+
+			break;
+
+		default:
+			pr_err("%s: Unknown tag 0x%08X\n", __func__,
+			       fdt32_to_cpu(tag));
+			ret = -EINVAL;
+			goto out;
+		}
+	} while (fdt32_to_cpu(tag) != FDT_END);
+
+	memcpy(fit_skeleton_grow(&skel, &skel_size, size_dt_strings),
+	       strings, size_dt_strings);
+
+	/* the skeleton always has the version 17 header fields */
+	fdt = skel;
+	*fdt = hdr;
+	fdt->version = cpu_to_fdt32(17);
+	fdt->last_comp_version = cpu_to_fdt32(16);
+	fdt->totalsize = cpu_to_fdt32(skel_size);
+	fdt->off_mem_rsvmap = cpu_to_fdt32(ALIGN(sizeof(hdr), 8));
+	fdt->off_dt_struct = cpu_to_fdt32(struct_start);
+	fdt->size_dt_struct = cpu_to_fdt32(skel_size - size_dt_strings -
+					   struct_start);
+	fdt->off_dt_strings = cpu_to_fdt32(skel_size - size_dt_strings);
+
+	handle->fit_alloc = skel;
+	handle->fit = skel;
+	handle->size = skel_size;
+	skel = NULL;
+
+	ret = 0;
+out:
+	if (ret)
+		pr_err("cannot parse FIT structure: %s\n", strerror(-ret));
+
+	free(skel);
+	free(strings);
+	free(s);
+
+	return ret;
+}
+
 static int fit_do_open(struct fit_handle *handle)
 {
 	const char *desc = "(no description)";
 	struct device_node *root;
+	struct fit_data *fd;
 
 	root = of_unflatten_dtb_const(handle->fit);
 	if (IS_ERR(root))
@@ -701,6 +1338,9 @@ static int fit_do_open(struct fit_handle *handle)
 
 	handle->root = root;
 
+	list_for_each_entry(fd, &handle->data, list)
+		fd->node = of_find_node_by_path_from(root, fd->path);
+
 	handle->images = of_get_child_by_name(handle->root, "images");
 	if (!handle->images)
 		return -ENOENT;
@@ -738,6 +1378,8 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
 	handle->fit = buf;
 	handle->size = size;
 	handle->verify = verify;
+	handle->fd = -1;
+	INIT_LIST_HEAD(&handle->data);
 
 	ret = fit_do_open(handle);
 	if (ret) {
@@ -757,6 +1399,10 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
  * This opens a FIT image found in @filename. The returned handle is used as
  * context for the other FIT functions.
  *
+ * Unless the file is on a filesystem which doesn't support seeking only the
+ * FIT structure is read here. The image data is read later by
+ * fit_open_image() or fit_load_image().
+ *
  * Return: A handle to a FIT image or a ERR_PTR
  */
 struct fit_handle *fit_open(const char *filename, bool verbose,
@@ -769,30 +1415,60 @@ struct fit_handle *fit_open(const char *filename, bool verbose,
 
 	handle->verbose = verbose;
 	handle->verify = verify;
+	handle->fd = -1;
+	INIT_LIST_HEAD(&handle->data);
 
-	ret = read_file_2(filename, &handle->size, &handle->fit_alloc,
-			  FILESIZE_MAX);
-	if (ret) {
-		pr_err("unable to read %s: %s\n", filename, strerror(-ret));
-		return ERR_PTR(ret);
-	}
+	if (is_tftp_fs(filename)) {
+		ret = read_file_2(filename, &handle->size, &handle->fit_alloc,
+				  FILESIZE_MAX);
+		if (ret) {
+			pr_err("unable to read %s: %s\n", filename,
+			       strerror(-ret));
+			goto err;
+		}
 
-	handle->fit = handle->fit_alloc;
+		handle->fit = handle->fit_alloc;
+	} else {
+		handle->fd = open(filename, O_RDONLY);
+		if (handle->fd < 0) {
+			ret = -errno;
+			pr_err("unable to open %s: %s\n", filename,
+			       strerror(-ret));
+			goto err;
+		}
 
-	ret = fit_do_open(handle);
-	if (ret) {
-		fit_close(handle);
-		return ERR_PTR(ret);
+		ret = fit_open_stream(handle);
+		if (ret)
+			goto err;
 	}
 
+	ret = fit_do_open(handle);
+	if (ret)
+		goto err;
+
 	return handle;
+err:
+	fit_close(handle);
+
+	return ERR_PTR(ret);
 }
 
 void fit_close(struct fit_handle *handle)
 {
+	struct fit_data *fd, *tmp;
+
 	if (handle->root)
 		of_delete_node(handle->root);
 
+	list_for_each_entry_safe(fd, tmp, &handle->data, list) {
+		free(fd->path);
+		free(fd->buf);
+		free(fd);
+	}
+
+	if (handle->fd >= 0)
+		close(handle->fd);
+
 	free(handle->fit_alloc);
 	free(handle);
 }
@@ -344,6 +344,62 @@ int uimage_load(struct uimage_handle *handle, unsigned int image_no,
 }
 EXPORT_SYMBOL(uimage_load);
 
+/*
+ * Request the region for an image at @adr. An image which is already
+ * accessible at @adr outside of SDRAM, like a kernel in memory mapped
+ * NOR flash, gets a standalone resource so that it can be executed in
+ * place. It can be released with release_sdram_region() like any other.
+ */
+static struct resource *image_request_region(const char *name,
+		unsigned long adr, size_t size, bool inplace)
+{
+	struct memory_bank *bank;
+	struct resource *res;
+
+	res = request_sdram_region(name, adr, size);
+	if (res || !inplace)
+		return res;
+
+	for_each_memory_bank(bank) {
+		if (adr + size > bank->start &&
+		    adr < bank->start + bank->size)
+			return NULL;
+	}
+
+	res = xzalloc(sizeof(*res));
+	res->name = xstrdup(name);
+	res->start = adr;
+	res->end = adr + size - 1;
+	INIT_LIST_HEAD(&res->children);
+	INIT_LIST_HEAD(&res->sibling);
+
+	return res;
+}
+
+/*
+ * Place @size bytes of an already memory mapped image at @adr. When the
+ * image is mapped at @adr already it is used in place, otherwise it is
+ * copied once instead of being read in BUFSIZ pieces.
+ */
+static struct resource *image_map_to_sdram(const char *name, const void *map,
+		unsigned long adr, size_t size)
+{
+	struct resource *res;
+	bool inplace = (unsigned long)map == adr;
+
+	res = image_request_region(name, adr, size, inplace);
+	if (!res) {
+		printf("unable to request SDRAM 0x%08lx-0x%08lx\n",
+			adr, adr + size - 1);
+		return NULL;
+	}
+
+	if (!inplace)
+		memmove((void *)adr, map, size);
+
+	return res;
+}
+
 static void *uimage_buf;
 static size_t uimage_size;
 static struct resource *uimage_resource;
@@ -381,12 +437,22 @@ struct resource *file_to_sdram(const char *filename, unsigned long adr)
 	size_t size = BUFSIZ;
 	size_t ofs = 0;
 	ssize_t now;
+	struct stat s;
+	void *map;
 	int fd;
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0)
 		return NULL;
 
+	map = memmap(fd, PROT_READ);
+	if (map != (void *)-1 && !fstat(fd, &s) &&
+	    s.st_size != FILE_SIZE_STREAM && s.st_size > 0 &&
+	    s.st_size <= SIZE_MAX) {
+		res = image_map_to_sdram("image", map, adr, s.st_size);
+		goto out;
+	}
+
 	while (1) {
 		res = request_sdram_region("image", adr, size);
 		if (!res) {
@@ -437,6 +503,18 @@ struct resource *uimage_load_to_sdram(struct uimage_handle *handle,
 	if (size < 0)
 		return NULL;
 
+	if (handle->header.ih_comp == IH_COMP_NONE ||
+	    handle->header.ih_type == IH_TYPE_RAMDISK) {
+		void *map = memmap(handle->fd, PROT_READ);
+
+		if (map != (void *)-1) {
+			map += handle->data_offset + handle->ihd[image_no].offset;
+
+			return image_map_to_sdram("uimage", map, load_address,
+						  size);
+		}
+	}
+
 	uimage_resource = request_sdram_region("uimage",
 				start, size);
 	if (!uimage_resource) {
@@ -140,37 +140,73 @@ static const ulong crc_table[256] = {
 #define DO4(buf)  DO2(buf); DO2(buf);
 #define DO8(buf)  DO4(buf); DO4(buf);
 
-/* ========================================================================= */
-STATIC uint32_t crc32(uint32_t crc, const void *_buf, unsigned int len)
+#if defined(__BAREBOX__) && defined(CONFIG_CRC32_SLICE_BY_8)
+
+/*
+ * Slicing-by-8: crc_table8[k][n] is the CRC of byte n followed by k zero
+ * bytes, so that eight input bytes can be folded into the CRC with eight
+ * independent table lookups.
+ */
+static uint32_t crc_table8[8][256];
+static int crc_table8_valid;
+
+static void make_crc_table8(void)
 {
-    const unsigned char *buf = _buf;
+	int n, k;
 
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
 	if (!crc_table)
 		make_crc_table();
 #endif
-    crc = crc ^ 0xffffffffL;
-    while (len >= 8)
-    {
-      DO8(buf);
-      len -= 8;
-    }
-    if (len) do {
-      DO1(buf);
-    } while (--len);
-    return crc ^ 0xffffffffL;
+	for (n = 0; n < 256; n++)
+		crc_table8[0][n] = crc_table[n];
+
+	for (k = 1; k < 8; k++)
+		for (n = 0; n < 256; n++)
+			crc_table8[k][n] = (crc_table8[k - 1][n] >> 8) ^
+				crc_table8[0][crc_table8[k - 1][n] & 0xff];
+
+	crc_table8_valid = 1;
 }
-#ifdef __BAREBOX__
-EXPORT_SYMBOL(crc32);
-#endif
 
-/* No ones complement version. JFFS2 (and other things ?)
- * don't use ones compliment in their CRC calculations.
- */
-STATIC uint32_t crc32_no_comp(uint32_t crc, const void *_buf, unsigned int len)
+static uint32_t crc32_le_generic(uint32_t crc, const unsigned char *buf,
+				 unsigned int len)
 {
-   const unsigned char *buf = _buf;
+	uint32_t (*t)[256] = crc_table8;
+
+	if (!crc_table8_valid)
+		make_crc_table8();
+
+	while (len && ((unsigned long)buf & 3)) {
+		crc = t[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8) {
+		const uint32_t *p = (const uint32_t *)buf;
+		uint32_t q1 = crc ^ le32_to_cpu(p[0]);
+		uint32_t q2 = le32_to_cpu(p[1]);
+
+		crc = t[7][q1 & 0xff] ^ t[6][(q1 >> 8) & 0xff] ^
+		      t[5][(q1 >> 16) & 0xff] ^ t[4][q1 >> 24] ^
+		      t[3][q2 & 0xff] ^ t[2][(q2 >> 8) & 0xff] ^
+		      t[1][(q2 >> 16) & 0xff] ^ t[0][q2 >> 24];
+
+		buf += 8;
+		len -= 8;
+	}
 
+	while (len--)
+		crc = t[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#else
+
+static uint32_t crc32_le_generic(uint32_t crc, const unsigned char *buf,
+				 unsigned int len)
+{
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
 	if (!crc_table)
 		make_crc_table();
@@ -187,6 +223,40 @@ STATIC uint32_t crc32_no_comp(uint32_t crc, const void *_buf, unsigned int len)
     return crc;
 }
 
+#endif
+
+#if defined(__BAREBOX__) && defined(CONFIG_CRC32_ARM64)
+#include <asm/crc32.h>
+
+static uint32_t crc32_le(uint32_t crc, const unsigned char *buf,
+			 unsigned int len)
+{
+	if (crc32_arm64_available())
+		return crc32_le_arm64(crc, buf, len);
+
+	return crc32_le_generic(crc, buf, len);
+}
+#else
+#define crc32_le crc32_le_generic
+#endif
+
+/* ========================================================================= */
+STATIC uint32_t crc32(uint32_t crc, const void *buf, unsigned int len)
+{
+    return crc32_le(crc ^ 0xffffffffL, buf, len) ^ 0xffffffffL;
+}
+#ifdef __BAREBOX__
+EXPORT_SYMBOL(crc32);
+#endif
+
+/* No ones complement version. JFFS2 (and other things ?)
+ * don't use ones compliment in their CRC calculations.
+ */
+STATIC uint32_t crc32_no_comp(uint32_t crc, const void *buf, unsigned int len)
+{
+    return crc32_le(crc, buf, len);
+}
+
 STATIC int file_crc(char *filename, ulong start, ulong size, ulong *crc,
 		    ulong *total)
 {
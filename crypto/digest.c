@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <module.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
 #include <crypto/internal.h>
 
 static LIST_HEAD(digests);
@@ -114,7 +115,9 @@ static struct digest_algo *digest_algo_get_by_name(const char *name)
 		return NULL;
 
 	list_for_each_entry(tmp, &digests, list) {
-		if (strcmp(tmp->base.name, name) != 0)
+		/* allow to pick a specific implementation by its driver name */
+		if (strcmp(tmp->base.name, name) != 0 &&
+		    strcmp(tmp->base.driver_name, name) != 0)
 			continue;
 
 		if (tmp->base.priority <= priority)
@@ -211,15 +214,103 @@ void digest_free(struct digest *d)
 }
 EXPORT_SYMBOL_GPL(digest_free);
 
+/*
+ * Feed a buffer to the digest in pieces of at most @chunk bytes so that
+ * hashing large mapped regions can still be interrupted with ctrl-c.
+ */
+static int digest_update_interruptible(struct digest *d, const void *buf,
+				       ulong len, ulong chunk)
+{
+	int ret;
+
+	while (len) {
+		ulong now = min(chunk, len);
+
+		if (ctrlc())
+			return -EINTR;
+
+		ret = digest_update(d, buf, now);
+		if (ret)
+			return ret;
+
+		buf += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate a bounce buffer for reading a file of (at most) @size bytes.
+ * Start with CONFIG_DIGEST_FILE_BUF_SIZE and fall back to smaller buffers
+ * when memory is tight.
+ */
+static void *digest_alloc_buf(ulong size, ulong *bufsize)
+{
+	ulong len = CONFIG_DIGEST_FILE_BUF_SIZE;
+	void *buf;
+
+	while (len > SZ_4K && len / 2 >= size)
+		len /= 2;
+
+	while (1) {
+		buf = malloc(len);
+		if (buf || len <= SZ_4K)
+			break;
+		len /= 2;
+	}
+
+	*bufsize = len;
+
+	return buf;
+}
+
+static int digest_file_read(struct digest *d, int fd, ulong start,
+			    ulong size)
+{
+	ulong bufsize;
+	void *buf;
+	int now, ret = 0;
+
+	if (start > 0 && lseek(fd, start, SEEK_SET) == -1) {
+		perror("lseek");
+		return -errno;
+	}
+
+	buf = digest_alloc_buf(size, &bufsize);
+	if (!buf)
+		return -ENOMEM;
+
+	while (size) {
+		now = read(fd, buf, min(bufsize, size));
+		if (now < 0) {
+			ret = now;
+			perror("read");
+			break;
+		}
+		if (!now)
+			break;
+
+		ret = digest_update_interruptible(d, buf, now, bufsize);
+		if (ret)
+			break;
+
+		size -= now;
+	}
+
+	free(buf);
+
+	return ret;
+}
+
 int digest_file_window(struct digest *d, const char *filename,
 		       unsigned char *hash,
 		       const unsigned char *sig,
 		       ulong start, ulong size)
 {
-	ulong len = 0;
-	int fd, now, ret = 0;
-	unsigned char *buf;
-	int flags = 0;
+	struct stat s;
+	unsigned char *map;
+	int fd, ret;
 
 	ret = digest_init(d);
 	if (ret)
@@ -231,60 +322,31 @@ int digest_file_window(struct digest *d, const char *filename,
 		return fd;
 	}
 
-	buf = memmap(fd, PROT_READ);
-	if (buf == (void *)-1) {
-		buf = xmalloc(4096);
-		flags = 1;
-	}
-
-	if (start > 0) {
-		if (flags) {
-			ret = lseek(fd, start, SEEK_SET);
-			if (ret == -1) {
-				perror("lseek");
-				goto out;
-			}
-		} else {
-			buf += start;
-		}
+	ret = fstat(fd, &s);
+	if (ret)
+		goto out;
+
+	/* A mapped file must not be hashed beyond its end */
+	if (s.st_size != FILE_SIZE_STREAM) {
+		if (start >= s.st_size)
+			size = 0;
+		else
+			size = min_t(u64, size, s.st_size - start);
 	}
 
-	while (size) {
-		now = min((ulong)4096, size);
-		if (flags) {
-			now = read(fd, buf, now);
-			if (now < 0) {
-				ret = now;
-				perror("read");
-				goto out_free;
-			}
-			if (!now)
-				break;
-		}
-
-		if (ctrlc()) {
-			ret = -EINTR;
-			goto out_free;
-		}
-
-		ret = digest_update(d, buf, now);
-		if (ret)
-			goto out_free;
-		size -= now;
-		len += now;
-
-		if (!flags)
-			buf += now;
-	}
+	map = memmap(fd, PROT_READ);
+	if (map != (void *)-1)
+		ret = digest_update_interruptible(d, map + start, size,
+						  CONFIG_DIGEST_FILE_BUF_SIZE);
+	else
+		ret = digest_file_read(d, fd, start, size);
+	if (ret)
+		goto out;
 
 	if (sig)
 		ret = digest_verify(d, sig);
 	else
 		ret = digest_final(d, hash);
-
-out_free:
-	if (flags)
-		free(buf);
 out:
 	close(fd);
 
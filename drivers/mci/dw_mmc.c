@@ -386,16 +386,31 @@ static int dwmci_write_data_pio(struct dwmci_host *host, struct mci_data *data)
 	return wlen;
 }
 
+static void
+dwmci_prepare_buffer(struct mci_host *mci, struct mci_data *data)
+{
+	unsigned int num_bytes = data->blocks * data->blocksize;
+
+	if (data->flags & MMC_DATA_WRITE)
+		dma_sync_single_for_device((unsigned long)data->src,
+					   num_bytes, DMA_TO_DEVICE);
+	else
+		dma_sync_single_for_device((unsigned long)data->dest,
+					   num_bytes, DMA_FROM_DEVICE);
+}
+
+/*
+ * Sends a command and starts the data transfer, if any. The data buffer
+ * must have been passed to dwmci_prepare_buffer() before.
+ */
 static int
-dwmci_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
+dwmci_submit_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 {
 	struct dwmci_host *host = to_dwmci_host(mci);
 	int flags = 0;
 	uint32_t mask;
-	uint32_t ctrl;
 	uint64_t start;
 	int ret;
-	unsigned int num_bytes = 0;
 
 	start = get_time_ns();
 	while (1) {
@@ -411,15 +426,6 @@ dwmci_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 	dwmci_writel(host, DWMCI_RINTSTS, DWMCI_INTMSK_ALL);
 
 	if (data) {
-		num_bytes = data->blocks * data->blocksize;
-
-		if (data->flags & MMC_DATA_WRITE)
-			dma_sync_single_for_device((unsigned long)data->src,
-						   num_bytes, DMA_TO_DEVICE);
-		else
-			dma_sync_single_for_device((unsigned long)data->dest,
-						   num_bytes, DMA_FROM_DEVICE);
-
 		ret = dwmci_prepare_data(host, data);
 		if (ret)
 			return ret;
@@ -486,7 +492,24 @@ dwmci_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 		}
 	}
 
+	return 0;
+}
+
+/*
+ * Waits for the data transfer started with dwmci_submit_cmd() to finish.
+ */
+static int
+dwmci_wait_data(struct mci_host *mci, struct mci_data *data)
+{
+	struct dwmci_host *host = to_dwmci_host(mci);
+	unsigned int num_bytes;
+	uint32_t mask;
+	uint32_t ctrl;
+	uint64_t start;
+
 	if (data) {
+		num_bytes = data->blocks * data->blocksize;
+
 		start = get_time_ns();
 		do {
 			mask = dwmci_readl(host, DWMCI_RINTSTS);
@@ -537,6 +560,21 @@ dwmci_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 	return 0;
 }
 
+static int
+dwmci_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
+{
+	int ret;
+
+	if (data)
+		dwmci_prepare_buffer(mci, data);
+
+	ret = dwmci_submit_cmd(mci, cmd, data);
+	if (ret)
+		return ret;
+
+	return dwmci_wait_data(mci, data);
+}
+
 static int dwmci_send_cmd(struct dwmci_host *host, u32 cmd, u32 arg)
 {
 	uint64_t start = get_time_ns();
@@ -702,6 +740,11 @@ static int dw_mmc_probe(struct device_d *dev)
 					 DMA_ADDRESS_BROKEN);
 
 	host->mci.send_cmd = dwmci_cmd;
+	host->mci.prepare_data = dwmci_prepare_buffer;
+	host->mci.submit_cmd = dwmci_submit_cmd;
+	host->mci.wait_data = dwmci_wait_data;
+	/* dwmci_prepare_data_dma() handles this many blocks at most */
+	host->mci.max_req_size = DW_MMC_NUM_IDMACS * 512;
 	host->mci.set_ios = dwmci_set_ios;
 	host->mci.init = dwmci_init;
 	host->mci.card_present = dwmci_card_present;
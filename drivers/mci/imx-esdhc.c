@@ -277,18 +277,29 @@ static int esdhc_do_data(struct mci_host *mci, struct mci_data *data)
 	return 0;
 }
 
+static void esdhc_prepare_data(struct mci_host *mci, struct mci_data *data)
+{
+	unsigned int num_bytes = data->blocks * data->blocksize;
+
+	if (data->flags & MMC_DATA_WRITE)
+		dma_sync_single_for_device((unsigned long)data->src,
+					   num_bytes, DMA_TO_DEVICE);
+	else
+		dma_sync_single_for_device((unsigned long)data->dest,
+					   num_bytes, DMA_FROM_DEVICE);
+}
+
 /*
- * Sends a command out on the bus.  Takes the mci pointer,
- * a command pointer, and an optional data pointer.
+ * Sends a command out on the bus and starts the data transfer, if any.
+ * The data buffer must have been passed to esdhc_prepare_data() before.
  */
 static int
-esdhc_send_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
+esdhc_submit_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 {
 	u32	xfertyp, mixctrl;
 	u32	irqstat;
 	struct fsl_esdhc_host *host = to_fsl_esdhc(mci);
 	void __iomem *regs = host->regs;
-	unsigned int num_bytes = 0;
 	int ret;
 
 	esdhc_write32(regs + SDHCI_INT_STATUS, -1);
@@ -303,16 +314,6 @@ esdhc_send_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 		err = esdhc_setup_data(mci, data);
 		if(err)
 			return err;
-
-		num_bytes = data->blocks * data->blocksize;
-
-		if (data->flags & MMC_DATA_WRITE)
-			dma_sync_single_for_device((unsigned long)data->src,
-						   num_bytes, DMA_TO_DEVICE);
-		else
-			dma_sync_single_for_device((unsigned long)data->dest,
-						   num_bytes, DMA_FROM_DEVICE);
-
 	}
 
 	/* Figure out the transfer arguments */
@@ -378,6 +379,19 @@ esdhc_send_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 	} else
 		cmd->response[0] = esdhc_read32(regs + SDHCI_RESPONSE_0);
 
+	return 0;
+}
+
+/*
+ * Waits for the data transfer started with esdhc_submit_cmd() to finish
+ * and for the bus to become idle.
+ */
+static int esdhc_wait_data(struct mci_host *mci, struct mci_data *data)
+{
+	struct fsl_esdhc_host *host = to_fsl_esdhc(mci);
+	void __iomem *regs = host->regs;
+	int ret;
+
 	/* Wait until all of the blocks are transferred */
 	if (data) {
 		ret = esdhc_do_data(mci, data);
@@ -406,6 +420,25 @@ esdhc_send_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
 	return 0;
 }
 
+/*
+ * Sends a command out on the bus.  Takes the mci pointer,
+ * a command pointer, and an optional data pointer.
+ */
+static int
+esdhc_send_cmd(struct mci_host *mci, struct mci_cmd *cmd, struct mci_data *data)
+{
+	int ret;
+
+	if (data)
+		esdhc_prepare_data(mci, data);
+
+	ret = esdhc_submit_cmd(mci, cmd, data);
+	if (ret)
+		return ret;
+
+	return esdhc_wait_data(mci, data);
+}
+
 static void set_sysctl(struct mci_host *mci, u32 clock)
 {
 	int div, pre_div;
@@ -673,7 +706,12 @@ static int fsl_esdhc_probe(struct device_d *dev)
 	if (caps & ESDHC_HOSTCAPBLT_HSS)
 		mci->host_caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED;
 
+	mci->host_caps |= MMC_CAP_CMD23;
+
 	host->mci.send_cmd = esdhc_send_cmd;
+	host->mci.prepare_data = esdhc_prepare_data;
+	host->mci.submit_cmd = esdhc_submit_cmd;
+	host->mci.wait_data = esdhc_wait_data;
 	host->mci.set_ios = esdhc_set_ios;
 	host->mci.init = esdhc_init;
 	host->mci.card_present = esdhc_card_present;
@@ -39,6 +39,9 @@
 
 #define MAX_BUFFER_NUMBER 0xffffffff
 
+/* for hosts which do not tell, what a 16 bit block counter can transfer */
+#define MCI_DEFAULT_MAX_REQ_SIZE	(0xffff * SECTOR_SIZE)
+
 #define UNSTUFF_BITS(resp,start,size)					\
 	({								\
 		const int __size = size;				\
@@ -133,6 +136,40 @@ static int mci_set_blocklen(struct mci *mci, unsigned len)
 
 static void *sector_buf;
 
+/*
+ * With CMD23 the card is told the number of blocks of a following multi
+ * block transfer, so that no CMD12 is needed to stop it.
+ */
+static bool mci_can_set_block_count(struct mci *mci, int blocks)
+{
+	if (blocks < 2 || blocks > 0xffff)
+		return false;
+
+	if (!(mci->host->host_caps & MMC_CAP_CMD23))
+		return false;
+
+	if (IS_SD(mci))
+		return mci->scr[0] & SD_SCR_CMD23_SUPPORT;
+
+	return mci->version >= MMC_VERSION_3;
+}
+
+static int mci_set_block_count(struct mci *mci, int blocks)
+{
+	struct mci_cmd cmd;
+
+	mci_setup_cmd(&cmd, MMC_CMD_SET_BLOCK_COUNT, blocks, MMC_RSP_R1);
+	return mci_send_cmd(mci, &cmd, NULL);
+}
+
+static void mci_stop_transmission(struct mci *mci)
+{
+	struct mci_cmd cmd;
+
+	mci_setup_cmd(&cmd, MMC_CMD_STOP_TRANSMISSION, 0, MMC_RSP_R1b);
+	mci_send_cmd(mci, &cmd, NULL);
+}
+
 /**
  * Write one or several blocks of data to the card
  * @param mci_dev MCI instance
@@ -148,6 +185,7 @@ static int mci_block_write(struct mci *mci, const void *src, int blocknum,
 	struct mci_data data;
 	const void *buf;
 	unsigned mmccmd;
+	bool sbc;
 	int ret;
 
 	if (blocks > 1)
@@ -172,29 +210,34 @@ static int mci_block_write(struct mci *mci, const void *src, int blocknum,
 	data.blocksize = mci->write_bl_len;
 	data.flags = MMC_DATA_WRITE;
 
+	sbc = mci_can_set_block_count(mci, blocks);
+	if (sbc) {
+		ret = mci_set_block_count(mci, blocks);
+		if (ret)
+			return ret;
+	}
+
 	ret = mci_send_cmd(mci, &cmd, &data);
 
-	if (ret || blocks > 1) {
-		mci_setup_cmd(&cmd, MMC_CMD_STOP_TRANSMISSION, 0, MMC_RSP_R1b);
-		mci_send_cmd(mci, &cmd, NULL);
-        }
+	if (ret || (blocks > 1 && !sbc))
+		mci_stop_transmission(mci);
 
 	return ret;
 }
 
-/**
- * Read one or several block(s) of data from the card
- * @param mci MCI instance
- * @param dst Where to store the data read from the card
- * @param blocknum Block number to read
- * @param blocks number of blocks to read
+/*
+ * A read request. The queued read path keeps two of these, one being
+ * transferred and the next one being prepared.
  */
-static int mci_read_block(struct mci *mci, void *dst, int blocknum,
-		int blocks)
-{
+struct mci_read_req {
 	struct mci_cmd cmd;
 	struct mci_data data;
-	int ret;
+	bool sbc;
+};
+
+static void mci_setup_read_req(struct mci *mci, struct mci_read_req *req,
+			       void *dst, int blocknum, int blocks)
+{
 	unsigned mmccmd;
 
 	if (blocks > 1)
@@ -202,25 +245,129 @@ static int mci_read_block(struct mci *mci, void *dst, int blocknum,
 	else
 		mmccmd = MMC_CMD_READ_SINGLE_BLOCK;
 
-	mci_setup_cmd(&cmd,
+	mci_setup_cmd(&req->cmd,
 		mmccmd,
 		mci->high_capacity != 0 ? blocknum : blocknum * mci->read_bl_len,
 		MMC_RSP_R1);
 
-	data.dest = dst;
-	data.blocks = blocks;
-	data.blocksize = mci->read_bl_len;
-	data.flags = MMC_DATA_READ;
+	req->data.dest = dst;
+	req->data.blocks = blocks;
+	req->data.blocksize = mci->read_bl_len;
+	req->data.flags = MMC_DATA_READ;
 
-	ret = mci_send_cmd(mci, &cmd, &data);
+	req->sbc = mci_can_set_block_count(mci, blocks);
+}
+
+/**
+ * Read one or several block(s) of data from the card
+ * @param mci MCI instance
+ * @param dst Where to store the data read from the card
+ * @param blocknum Block number to read
+ * @param blocks number of blocks to read
+ */
+static int mci_read_block(struct mci *mci, void *dst, int blocknum,
+		int blocks)
+{
+	struct mci_read_req req;
+	int ret;
+
+	mci_setup_read_req(mci, &req, dst, blocknum, blocks);
 
-	if (ret || blocks > 1) {
-		mci_setup_cmd(&cmd, MMC_CMD_STOP_TRANSMISSION, 0, MMC_RSP_R1b);
-		mci_send_cmd(mci, &cmd, NULL);
+	if (req.sbc) {
+		ret = mci_set_block_count(mci, blocks);
+		if (ret)
+			return ret;
 	}
+
+	ret = mci_send_cmd(mci, &req.cmd, &req.data);
+
+	if (ret || (blocks > 1 && !req.sbc))
+		mci_stop_transmission(mci);
+
+	return ret;
+}
+
+static int mci_submit_read(struct mci *mci, struct mci_read_req *req)
+{
+	struct mci_host *host = mci->host;
+	int ret;
+
+	if (req->sbc) {
+		ret = mci_set_block_count(mci, req->data.blocks);
+		if (ret)
+			return ret;
+	}
+
+	return host->submit_cmd(host, &req->cmd, &req->data);
+}
+
+static int mci_finish_read(struct mci *mci, struct mci_read_req *req, int ret)
+{
+	struct mci_host *host = mci->host;
+
+	if (!ret)
+		ret = host->wait_data(host, &req->data);
+
+	if (ret || (req->data.blocks > 1 && !req->sbc))
+		mci_stop_transmission(mci);
+
 	return ret;
 }
 
+/**
+ * Read blocks from the card using the queued host interface
+ * @param mci MCI instance
+ * @param dst Where to store the data read from the card
+ * @param blocknum Block number to start reading from
+ * @param blocks number of blocks to read
+ * @param max_req_block maximum number of blocks per request
+ *
+ * The next request is prepared while the data of the current one is
+ * transferred, so that the host can setup its DMA and do the cache
+ * maintenance for the next buffer in parallel.
+ */
+static int mci_read_blocks_queued(struct mci *mci, void *dst, int blocknum,
+		int blocks, unsigned max_req_block)
+{
+	struct mci_host *host = mci->host;
+	struct mci_read_req req[2], *cur = &req[0], *next;
+	int ret;
+
+	mci_setup_read_req(mci, cur, dst, blocknum,
+			   min_t(int, blocks, max_req_block));
+	host->prepare_data(host, &cur->data);
+
+	ret = mci_submit_read(mci, cur);
+
+	while (1) {
+		blocks -= cur->data.blocks;
+		blocknum += cur->data.blocks;
+		dst += cur->data.blocks * mci->read_bl_len;
+
+		next = NULL;
+
+		if (blocks && !ret) {
+			next = cur == &req[0] ? &req[1] : &req[0];
+			mci_setup_read_req(mci, next, dst, blocknum,
+					   min_t(int, blocks, max_req_block));
+			host->prepare_data(host, &next->data);
+		}
+
+		ret = mci_finish_read(mci, cur, ret);
+		if (ret) {
+			dev_dbg(&mci->dev, "Reading block %d failed with %d\n",
+				blocknum - cur->data.blocks, ret);
+			return ret;
+		}
+
+		if (!next)
+			return 0;
+
+		ret = mci_submit_read(mci, next);
+		cur = next;
+	}
+}
+
 /**
  * Reset the attached MMC/SD card
  * @param mci MCI instance
@@ -1362,6 +1509,10 @@ static int mci_sd_read(struct block_device *blk, void *buffer, int block,
 		return -EINVAL;
 	}
 
+	if (mci->host->submit_cmd)
+		return mci_read_blocks_queued(mci, buffer, block, num_blocks,
+					      max_req_block);
+
 	while (num_blocks) {
 		read_block = min_t(int, num_blocks, max_req_block);
 		rc = mci_read_block(mci, buffer, block, read_block);
@@ -1815,6 +1966,9 @@ int mci_register(struct mci_host *host)
 	host->mci = mci;
 	mci->dev.detect = mci_detect;
 
+	if (!host->max_req_size)
+		host->max_req_size = MCI_DEFAULT_MAX_REQ_SIZE;
+
 	host->supply = regulator_get(host->hw_dev, "vmmc");
 	if (IS_ERR(host->supply))
 		dev_err(&mci->dev, "Failed to get 'vmmc' regulator.\n");
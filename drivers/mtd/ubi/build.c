@@ -29,6 +29,8 @@
 #include <linux/stringify.h>
 #include <linux/stat.h>
 #include <linux/log2.h>
+#include <linux/math64.h>
+#include <clock.h>
 #include "ubi.h"
 
 /* Maximum length of the 'mtd=' parameter */
@@ -53,7 +55,7 @@ struct mtd_dev_param {
 /* MTD devices specification parameters */
 #ifdef CONFIG_MTD_UBI_FASTMAP
 /* UBI module parameter to enable fastmap automatically on non-fastmap images */
-static bool fm_autoconvert = 1;
+static bool fm_autoconvert = IS_ENABLED(CONFIG_MTD_UBI_FASTMAP_AUTOCONVERT);
 #endif
 
 /* All UBI devices in system */
@@ -80,6 +82,11 @@ int ubi_volume_notify(struct ubi_device *ubi, struct ubi_volume *vol, int ntype)
 	case UBI_VOLUME_REMOVED:
 	case UBI_VOLUME_RESIZED:
 	case UBI_VOLUME_RENAMED:
+	/*
+	 * Unlike Linux, refresh the fastmap after updates as well, they are
+	 * rare in barebox and the next attach will be faster.
+	 */
+	case UBI_VOLUME_UPDATED:
 		ret = ubi_update_fastmap(ubi);
 		if (ret)
 			ubi_msg(ubi, "Unable to write a new fastmap: %i", ret);
@@ -506,6 +513,8 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num,
 {
 	struct ubi_device *ubi;
 	int i, err, ref = 0;
+	uint64_t start;
+	bool fastmap;
 
 	if (max_beb_per1024 < 0 || max_beb_per1024 > MAX_MTD_UBI_BEB_LIMIT)
 		return -EINVAL;
@@ -615,6 +624,8 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num,
 	if (!ubi->fm_buf)
 		goto out_free;
 #endif
+	start = get_time_ns();
+
 	err = ubi_attach(ubi, 0);
 	if (err) {
 		ubi_err(ubi, "failed to attach mtd%d, error %d",
@@ -622,6 +633,11 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num,
 		goto out_free;
 	}
 
+	fastmap = ubi->fm != NULL;
+	ubi_msg(ubi, "attached by %s in %llu ms",
+		fastmap ? "fastmap" : "scanning",
+		div_u64(get_time_ns() - start, MSECOND));
+
 	ubi->thread_enabled = 1;
 
 	/* No threading, call ubi_thread directly */
@@ -633,6 +649,15 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num,
 			goto out_detach;
 	}
 
+	/* Install a fastmap right away so that the next attach is fast */
+	if (!fastmap && !ubi->fm_disabled && !ubi->ro_mode) {
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			ubi_warn(ubi, "Unable to write a new fastmap: %i", err);
+		else if (ubi->fm)
+			ubi_msg(ubi, "fastmap written");
+	}
+
 	err = uif_init(ubi, &ref);
 	if (err)
 		goto out_detach;
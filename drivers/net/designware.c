@@ -154,13 +154,12 @@ static void rx_descs_init(struct eth_device *dev)
 	struct dw_eth_dev *priv = dev->priv;
 	struct eth_dma_regs *dma_p = priv->dma_regs_p;
 	struct dmamacdescr *desc_table_p = &priv->rx_mac_descrtable[0];
-	char *rxbuffs = &priv->rxbuffs[0];
 	struct dmamacdescr *desc_p;
 	u32 idx;
 
 	for (idx = 0; idx < CONFIG_RX_DESCR_NUM; idx++) {
 		desc_p = &desc_table_p[idx];
-		desc_p->dmamac_addr = &rxbuffs[idx * CONFIG_ETH_BUFSIZE];
+		desc_p->dmamac_addr = priv->rx_pb[idx]->data;
 		desc_p->dmamac_next = &desc_table_p[idx + 1];
 
 		desc_p->dmamac_cntl = MAC_MAX_FRAME_SZ;
@@ -331,41 +330,79 @@ static int dwc_ether_send(struct eth_device *dev, void *packet, int length)
 	return 0;
 }
 
-static int dwc_ether_rx(struct eth_device *dev)
+static void dwc_ether_rx_frame(struct eth_device *dev, u32 desc_num)
 {
 	struct dw_eth_dev *priv = dev->priv;
-	u32 desc_num = priv->rx_currdescnum;
 	struct dmamacdescr *desc_p = &priv->rx_mac_descrtable[desc_num];
-
+	struct pktbuf *pb = priv->rx_pb[desc_num];
 	u32 status = desc_p->txrx_status;
-	int length = 0;
-
-	/* Check  if the owner is the CPU */
-	if (status & DESC_RXSTS_OWNBYDMA)
-		return 0;
+	int length;
 
 	length = (status & DESC_RXSTS_FRMLENMSK) >>
 		 DESC_RXSTS_FRMLENSHFT;
 
+	if (status & DESC_RXSTS_ERROR) {
+		dev->rx_dropped++;
+	} else {
+		dma_sync_single_for_cpu((unsigned long)pb->data, length,
+					DMA_FROM_DEVICE);
+		pb = net_receive_pktbuf(dev, pb, length);
+	}
+
 	/*
-	 * Make the current descriptor valid again and go to
-	 * the next one
+	 * Make the descriptor valid again, with a new buffer if the stack
+	 * kept the old one
 	 */
-	dma_sync_single_for_cpu((unsigned long)desc_p->dmamac_addr, length,
-				DMA_FROM_DEVICE);
-	net_receive(dev, desc_p->dmamac_addr, length);
-	dma_sync_single_for_device((unsigned long)desc_p->dmamac_addr, length,
+	if (pb != priv->rx_pb[desc_num]) {
+		priv->rx_pb[desc_num] = pb;
+		desc_p->dmamac_addr = pb->data;
+		length = MAC_MAX_FRAME_SZ;
+	}
+
+	dma_sync_single_for_device((unsigned long)pb->data, length,
 				   DMA_FROM_DEVICE);
 
 	desc_p->txrx_status |= DESC_RXSTS_OWNBYDMA;
+}
 
-	/* Test the wrap-around condition. */
-	if (++desc_num >= CONFIG_RX_DESCR_NUM)
-		desc_num = 0;
+static int dwc_ether_poll(struct eth_device *dev, int budget)
+{
+	struct dw_eth_dev *priv = dev->priv;
+	struct eth_dma_regs *dma_p = priv->dma_regs_p;
+	u32 desc_num = priv->rx_currdescnum;
+	u32 status;
+	int received = 0;
+
+	/*
+	 * The DMA stops when it finds no free descriptor and drops frames
+	 * until it is told to go on.
+	 */
+	status = readl(&dma_p->status) & (DMA_STATUS_RU | DMA_STATUS_OVF);
+	if (status) {
+		writel(status, &dma_p->status);
+		dev->rx_ring_full++;
+	}
+
+	while (received < budget) {
+		/* Check if the owner is the CPU */
+		if (priv->rx_mac_descrtable[desc_num].txrx_status &
+		    DESC_RXSTS_OWNBYDMA)
+			break;
+
+		dwc_ether_rx_frame(dev, desc_num);
+		received++;
+
+		/* Test the wrap-around condition. */
+		if (++desc_num >= CONFIG_RX_DESCR_NUM)
+			desc_num = 0;
+	}
 
 	priv->rx_currdescnum = desc_num;
 
-	return length;
+	if (status & DMA_STATUS_RU)
+		writel(POLL_DATA, &dma_p->rxpolldemand);
+
+	return received;
 }
 
 static void dwc_ether_halt (struct eth_device *dev)
@@ -425,7 +462,7 @@ struct dw_eth_dev *dwc_drv_probe(struct device_d *dev)
 	struct mii_bus *miibus;
 	void __iomem *base;
 	struct dwc_ether_platform_data *pdata = dev->platform_data;
-	int ret;
+	int ret, i;
 	struct dw_eth_drvdata *drvdata;
 
 	priv = xzalloc(sizeof(struct dw_eth_dev));
@@ -465,7 +502,15 @@ struct dw_eth_dev *dwc_drv_probe(struct device_d *dev)
 		CONFIG_RX_DESCR_NUM * sizeof(struct dmamacdescr),
 		DMA_ADDRESS_BROKEN);
 	priv->txbuffs = dma_alloc(TX_TOTAL_BUFSIZE);
-	priv->rxbuffs = dma_alloc(RX_TOTAL_BUFSIZE);
+
+	/* the MAC is told it can write MAC_MAX_FRAME_SZ bytes */
+	BUILD_BUG_ON(MAC_MAX_FRAME_SZ > PKTBUF_SIZE);
+
+	for (i = 0; i < CONFIG_RX_DESCR_NUM; i++) {
+		priv->rx_pb[i] = pktbuf_alloc();
+		if (!priv->rx_pb[i])
+			return ERR_PTR(-ENOMEM);
+	}
 
 	edev = &priv->netdev;
 	miibus = &priv->miibus;
@@ -474,7 +519,7 @@ struct dw_eth_dev *dwc_drv_probe(struct device_d *dev)
 	edev->parent = dev;
 	edev->open = dwc_ether_open;
 	edev->send = dwc_ether_send;
-	edev->recv = dwc_ether_rx;
+	edev->poll = dwc_ether_poll;
 	edev->halt = dwc_ether_halt;
 	edev->get_ethaddr = dwc_ether_get_ethaddr;
 	edev->set_ethaddr = dwc_ether_set_ethaddr;
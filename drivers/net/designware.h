@@ -22,6 +22,11 @@
 
 #include <net.h>
 
+#define CONFIG_TX_DESCR_NUM	16
+#define CONFIG_RX_DESCR_NUM	16
+#define CONFIG_ETH_BUFSIZE	2048
+#define TX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_TX_DESCR_NUM)
+
 struct dw_eth_dev {
 	struct eth_device netdev;
 	struct mii_bus miibus;
@@ -35,7 +40,7 @@ struct dw_eth_dev {
 	struct dmamacdescr *rx_mac_descrtable;
 
 	u8 *txbuffs;
-	u8 *rxbuffs;
+	struct pktbuf *rx_pb[CONFIG_RX_DESCR_NUM];
 
 	struct eth_mac_regs *mac_regs_p;
 	struct eth_dma_regs *dma_regs_p;
@@ -52,12 +57,6 @@ struct dw_eth_drvdata {
 
 struct dw_eth_dev *dwc_drv_probe(struct device_d *dev);
 
-#define CONFIG_TX_DESCR_NUM	16
-#define CONFIG_RX_DESCR_NUM	16
-#define CONFIG_ETH_BUFSIZE	2048
-#define TX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_TX_DESCR_NUM)
-#define RX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_RX_DESCR_NUM)
-
 struct eth_mac_regs {
 	u32 conf;		/* 0x00 */
 	u32 framefilt;		/* 0x04 */
@@ -136,6 +135,10 @@ struct eth_dma_regs {
 /* Poll demand definitions */
 #define POLL_DATA		(0xFFFFFFFF)
 
+/* Status register definitions */
+#define DMA_STATUS_RU		(1 << 7)	/* receive buffer unavailable */
+#define DMA_STATUS_OVF		(1 << 4)	/* receive FIFO overflow */
+
 /* Operation mode definitions */
 #define STOREFORWARD		(1 << 21)
 #define FLUSHTXFIFO		(1 << 20)
@@ -27,6 +27,7 @@
 struct tap_priv {
 	int fd;
 	char *name;
+	struct pktbuf *rx_pb;
 };
 
 static int tap_eth_send(struct eth_device *edev, void *packet, int length)
@@ -37,17 +38,22 @@ static int tap_eth_send(struct eth_device *edev, void *packet, int length)
 	return 0;
 }
 
-static int tap_eth_rx(struct eth_device *edev)
+static int tap_eth_poll(struct eth_device *edev, int budget)
 {
 	struct tap_priv *priv = edev->priv;
-	int length;
+	int length, received = 0;
 
-	length = linux_read_nonblock(priv->fd, NetRxPackets[0], PKTSIZE);
+	while (received < budget) {
+		length = linux_read_nonblock(priv->fd, priv->rx_pb->data,
+					     PKTSIZE);
+		if (length <= 0)
+			break;
 
-	if (length > 0)
-		net_receive(edev, NetRxPackets[0], length);
+		priv->rx_pb = net_receive_pktbuf(edev, priv->rx_pb, length);
+		received++;
+	}
 
-	return 0;
+	return received;
 }
 
 static int tap_eth_open(struct eth_device *edev)
@@ -77,7 +83,7 @@ static int tap_probe(struct device_d *dev)
 	int ret = 0;
 
 	priv = xzalloc(sizeof(struct tap_priv));
-	priv->name = "barebox";
+	priv->name = xstrdup("barebox");
 
 	priv->fd = tap_alloc(priv->name);
 	if (priv->fd < 0) {
@@ -85,6 +91,12 @@ static int tap_probe(struct device_d *dev)
 		goto out;
 	}
 
+	priv->rx_pb = pktbuf_alloc();
+	if (!priv->rx_pb) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	edev = xzalloc(sizeof(struct eth_device));
 	edev->priv = priv;
 	edev->parent = dev;
@@ -92,7 +104,7 @@ static int tap_probe(struct device_d *dev)
 	edev->init = tap_eth_open;
 	edev->open = tap_eth_open;
 	edev->send = tap_eth_send;
-	edev->recv = tap_eth_rx;
+	edev->poll = tap_eth_poll;
 	edev->halt = tap_eth_halt;
 	edev->get_ethaddr = tap_get_ethaddr;
 	edev->set_ethaddr = tap_set_ethaddr;
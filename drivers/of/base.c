@@ -25,6 +25,7 @@
 #include <init.h>
 #include <memory.h>
 #include <linux/sizes.h>
+#include <linux/log2.h>
 #include <of_graph.h>
 #include <linux/ctype.h>
 #include <linux/amba/bus.h>
@@ -52,6 +53,69 @@ static inline struct device_node *of_next_node(struct device_node *node)
 #define of_tree_for_each_node_from(node, from) \
 	for (node = of_next_node(from); node; node = of_next_node(node))
 
+/*
+ * Direct mapped cache for phandle lookups. Entries are only trusted after
+ * checking the phandle and the tree of the cached node, so a collision or
+ * a lookup in another tree just falls back to walking the tree. Nodes are
+ * removed from the cache when they are deleted.
+ */
+static struct device_node **phandle_cache;
+static unsigned int phandle_cache_mask;
+
+static struct device_node *of_node_get_root(struct device_node *node)
+{
+	while (node->parent)
+		node = node->parent;
+
+	return node;
+}
+
+static void of_phandle_cache_remove(struct device_node *node)
+{
+	struct device_node **entry;
+
+	if (!phandle_cache || !node->phandle)
+		return;
+
+	entry = &phandle_cache[node->phandle & phandle_cache_mask];
+	if (*entry == node)
+		*entry = NULL;
+}
+
+static void of_phandle_cache_free(void)
+{
+	free(phandle_cache);
+	phandle_cache = NULL;
+	phandle_cache_mask = 0;
+}
+
+static void of_phandle_cache_populate(struct device_node *root)
+{
+	struct device_node *node;
+	unsigned int count = 0;
+
+	of_phandle_cache_free();
+
+	if (!root)
+		return;
+
+	of_tree_for_each_node_from(node, root)
+		if (node->phandle)
+			count++;
+
+	if (!count)
+		return;
+
+	count = roundup_pow_of_two(count);
+
+	phandle_cache = xzalloc(count * sizeof(*phandle_cache));
+	phandle_cache_mask = count - 1;
+
+	of_tree_for_each_node_from(node, root)
+		if (node->phandle)
+			phandle_cache[node->phandle & phandle_cache_mask] = node;
+}
+
 /**
  * struct alias_prop - Alias property in 'aliases' node
  * @link:	List node to link the structure in aliases_lookup list
@@ -281,11 +345,24 @@ EXPORT_SYMBOL_GPL(of_find_node_by_alias);
 struct device_node *of_find_node_by_phandle_from(phandle phandle,
 		struct device_node *root)
 {
-	struct device_node *node;
+	struct device_node *node, **entry = NULL;
+	struct device_node *top = root ? root : root_node;
 
-	of_tree_for_each_node_from(node, root)
-		if (node->phandle == phandle)
+	if (phandle_cache && phandle && top && !top->parent) {
+		entry = &phandle_cache[phandle & phandle_cache_mask];
+		node = *entry;
+		if (node && node->phandle == phandle &&
+		    of_node_get_root(node) == top)
+			return node;
+	}
+
+	of_tree_for_each_node_from(node, root) {
+		if (node->phandle == phandle) {
+			if (entry)
+				*entry = node;
 			return node;
+		}
+	}
 
 	return NULL;
 }
@@ -1612,6 +1689,8 @@ int of_set_root_node(struct device_node *node)
 
 	root_node = node;
 
+	of_phandle_cache_populate(root_node);
+
 	of_alias_scan();
 
 	return 0;
@@ -2091,6 +2170,8 @@ void of_delete_node(struct device_node *node)
 	if (dev)
 		dev->device_node = NULL;
 
+	of_phandle_cache_remove(node);
+
 	free(node->name);
 	free(node->full_name);
 	free(node);
@@ -287,135 +287,174 @@ struct device_node *of_unflatten_dtb_const(const void *infdt)
 	return __of_unflatten_dtb(infdt, true);
 }
 
+/*
+ * Property names are deduplicated in the strings block. @str_hash is an
+ * open addressing hash table of the names added so far, it never gets
+ * more than half full.
+ */
+struct fdt_string {
+	const char *name;
+	uint32_t ofs;
+};
+
 struct fdt {
 	void *dt;
 	uint32_t dt_nextofs;
-	uint32_t dt_size;
-	char *strings;
-	uint32_t str_nextofs;
+	uint32_t str_start;
 	uint32_t str_size;
+	struct fdt_string *str_hash;
+	unsigned int str_hash_size;
+	unsigned int str_count;
 };
 
+/* We assume strings and names have a maximum length of 1024 */
+#define FDT_MAX_NAME_LEN	1023
+
 static inline uint32_t dt_next_ofs(uint32_t curofs, uint32_t len)
 {
 	return ALIGN(curofs + len, 4);
 }
 
-static int lstrcpy(char *dest, const char *src)
+static unsigned int dt_string_hash(const char *str)
 {
-	int len = 0;
-	int maxlen = 1023;
-
-	while (*src) {
-		*dest++ = *src++;
-		len++;
-		if (!maxlen)
-			return -ENOSPC;
-		maxlen--;
+	unsigned int hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619;
 	}
 
-	return len;
+	return hash;
 }
 
-static void *memalign_realloc(void *orig, size_t oldsize, size_t newsize)
+static struct fdt_string *dt_find_string(struct fdt_string *table,
+					 unsigned int size, const char *str)
 {
-	int align;
-	void *newbuf;
+	unsigned int i = dt_string_hash(str) & (size - 1);
 
-	/*
-	 * ARM Linux uses a single 1MiB section (with 1MiB alignment)
-	 * for mapping the devicetree, so we are not allowed to cross
-	 * 1MiB boundaries. This got fixed in the Kernel since v3.8-rc5
-	 */
-	align = 1 << fls(newsize - 1);
+	while (table[i].name && strcmp(table[i].name, str))
+		i = (i + 1) & (size - 1);
+
+	return &table[i];
+}
 
-	if (!orig)
-		return memalign(align, newsize);
+static void dt_grow_string_hash(struct fdt *fdt)
+{
+	unsigned int size = fdt->str_hash_size * 2;
+	struct fdt_string *table;
+	int i;
 
-	newbuf = memalign(align, newsize);
-	if (!newbuf) {
-		free(orig);
-		return NULL;
-	}
+	table = xzalloc(size * sizeof(*table));
+
+	for (i = 0; i < fdt->str_hash_size; i++) {
+		struct fdt_string *s = &fdt->str_hash[i];
 
-	memcpy(newbuf, orig, oldsize);
-	free(orig);
-	memset(newbuf + oldsize, 0, newsize - oldsize);
+		if (s->name)
+			*dt_find_string(table, size, s->name) = *s;
+	}
 
-	return newbuf;
+	free(fdt->str_hash);
+	fdt->str_hash = table;
+	fdt->str_hash_size = size;
 }
 
-static int fdt_ensure_space(struct fdt *fdt, int dtsize)
+static int dt_add_string(struct fdt *fdt, const char *str)
 {
-	/*
-	 * We assume strings and names have a maximum length of 1024
-	 * whereas properties can be longer. We allocate new memory
-	 * if we have less than 1024 bytes (+ the property size left.
-	 */
-	if (fdt->str_size - fdt->str_nextofs < 1024) {
-		fdt->strings = realloc(fdt->strings, fdt->str_size * 2);
-		if (!fdt->strings)
-			return -ENOMEM;
-		fdt->str_size *= 2;
-	}
+	struct fdt_string *s;
+	size_t len;
 
-	if (fdt->dt_size - fdt->dt_nextofs < 1024 + dtsize) {
-		fdt->dt = memalign_realloc(fdt->dt, fdt->dt_size,
-				fdt->dt_size * 2);
-		if (!fdt->dt)
-			return -ENOMEM;
-		fdt->dt_size *= 2;
-	}
+	if ((fdt->str_count + 1) * 2 > fdt->str_hash_size)
+		dt_grow_string_hash(fdt);
+
+	s = dt_find_string(fdt->str_hash, fdt->str_hash_size, str);
+	if (s->name)
+		return 0;
+
+	len = strlen(str);
+	if (len > FDT_MAX_NAME_LEN)
+		return -ENOSPC;
+
+	s->name = str;
+	s->ofs = fdt->str_size;
+
+	fdt->str_size += len + 1;
+	fdt->str_count++;
 
 	return 0;
 }
 
-static inline int dt_add_string(struct fdt *fdt, const char *str)
+static inline uint32_t dt_string_ofs(struct fdt *fdt, const char *str)
 {
-	uint32_t ret;
-	int len;
+	return dt_find_string(fdt->str_hash, fdt->str_hash_size, str)->ofs;
+}
 
-	if (fdt_ensure_space(fdt, 0) < 0)
-		return -ENOMEM;
+/*
+ * First pass: Calculate the size of the structure block and collect the
+ * property names for the strings block.
+ */
+static int __of_flatten_dtb_size(struct fdt *fdt, struct device_node *node,
+				 int is_root)
+{
+	struct property *p;
+	struct device_node *n;
+	size_t len;
+	int ret;
 
-	len = lstrcpy(fdt->strings + fdt->str_nextofs, str);
-	if (len < 0)
+	len = strlen(node->name);
+	if (len > FDT_MAX_NAME_LEN)
 		return -ENOSPC;
 
-	ret = fdt->str_nextofs;
+	fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs, 4 + len + 1);
+
+	list_for_each_entry(p, &node->properties, list) {
+		ret = dt_add_string(fdt, p->name);
+		if (ret)
+			return ret;
+
+		fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs,
+				sizeof(struct fdt_property) + p->length);
+	}
+
+	list_for_each_entry(n, &node->children, parent_list) {
+		if (is_root && !strcmp(n->name, "memreserve"))
+			continue;
+
+		ret = __of_flatten_dtb_size(fdt, n, 0);
+		if (ret)
+			return ret;
+	}
 
-	fdt->str_nextofs += len + 1;
+	fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs,
+			sizeof(struct fdt_node_header));
 
-	return ret;
+	return 0;
 }
 
-static int __of_flatten_dtb(struct fdt *fdt, struct device_node *node, int is_root)
+/*
+ * Second pass: Write the structure block. The buffer has been allocated
+ * with the size calculated in the first pass and is zeroed, so we do not
+ * have to care about padding.
+ */
+static void __of_flatten_dtb(struct fdt *fdt, struct device_node *node, int is_root)
 {
 	struct property *p;
 	struct device_node *n;
-	int ret;
-	unsigned int len;
 	struct fdt_node_header *nh;
 
-	if (fdt_ensure_space(fdt, 0) < 0)
-		return -ENOMEM;
-
 	nh = fdt->dt + fdt->dt_nextofs;
 	nh->tag = cpu_to_fdt32(FDT_BEGIN_NODE);
-	len = lstrcpy(nh->name, node->name);
-	fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs, 4 + len + 1);
+	strcpy(nh->name, node->name);
+	fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs,
+			4 + strlen(node->name) + 1);
 
 	list_for_each_entry(p, &node->properties, list) {
 		struct fdt_property *fp;
 
-		if (fdt_ensure_space(fdt, p->length) < 0)
-			return -ENOMEM;
-
 		fp = fdt->dt + fdt->dt_nextofs;
 
 		fp->tag = cpu_to_fdt32(FDT_PROP);
 		fp->len = cpu_to_fdt32(p->length);
-		fp->nameoff = cpu_to_fdt32(dt_add_string(fdt, p->name));
+		fp->nameoff = cpu_to_fdt32(dt_string_ofs(fdt, p->name));
 		memcpy(fp->data, p->value, p->length);
 		fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs,
 				sizeof(struct fdt_property) + p->length);
@@ -425,20 +464,13 @@ static int __of_flatten_dtb(struct fdt *fdt, struct device_node *node, int is_ro
 		if (is_root && !strcmp(n->name, "memreserve"))
 			continue;
 
-		ret = __of_flatten_dtb(fdt, n, 0);
-		if (ret)
-			return ret;
+		__of_flatten_dtb(fdt, n, 0);
 	}
 
 	nh = fdt->dt + fdt->dt_nextofs;
 	nh->tag = cpu_to_fdt32(FDT_END_NODE);
 	fdt->dt_nextofs = dt_next_ofs(fdt->dt_nextofs,
 			sizeof(struct fdt_node_header));
-
-	if (fdt_ensure_space(fdt, 0) < 0)
-		return -ENOMEM;
-
-	return 0;
 }
 
 /**
@@ -447,10 +479,10 @@ static int __of_flatten_dtb(struct fdt *fdt, struct device_node *node, int is_ro
  */
 void *of_flatten_dtb(struct device_node *node)
 {
-	int ret;
+	int i, ret;
 	struct fdt_header header = {};
 	struct fdt fdt = {};
-	uint32_t ofs, off_mem_rsvmap;
+	uint32_t ofs, off_mem_rsvmap, totalsize;
 	struct fdt_node_header *nh;
 	struct device_node *memreserve;
 	int len;
@@ -459,13 +491,8 @@ void *of_flatten_dtb(struct device_node *node)
 	header.version = cpu_to_fdt32(0x11);
 	header.last_comp_version = cpu_to_fdt32(0x10);
 
-	fdt.dt = xmemalign(SZ_64K, SZ_64K);
-	fdt.dt_size = SZ_64K;
-
-	fdt.strings = xzalloc(SZ_64K);
-	fdt.str_size = SZ_64K;
-
-	memset(fdt.dt, 0, SZ_64K);
+	fdt.str_hash_size = 64;
+	fdt.str_hash = xzalloc(fdt.str_hash_size * sizeof(*fdt.str_hash));
 
 	ofs = sizeof(struct fdt_header);
 
@@ -475,10 +502,31 @@ void *of_flatten_dtb(struct device_node *node)
 
 	fdt.dt_nextofs = ofs;
 
-	ret = __of_flatten_dtb(&fdt, node, 1);
+	ret = __of_flatten_dtb_size(&fdt, node, 1);
 	if (ret)
 		goto out_free;
 
+	/* FDT_END */
+	fdt.dt_nextofs = dt_next_ofs(fdt.dt_nextofs, sizeof(struct fdt_node_header));
+
+	fdt.str_start = fdt.dt_nextofs;
+	totalsize = fdt.str_start + fdt.str_size;
+
+	/*
+	 * ARM Linux uses a single 1MiB section (with 1MiB alignment)
+	 * for mapping the devicetree, so we are not allowed to cross
+	 * 1MiB boundaries. This got fixed in the Kernel since v3.8-rc5
+	 */
+	fdt.dt = memalign(1 << fls(totalsize - 1), totalsize);
+	if (!fdt.dt)
+		goto out_free;
+
+	memset(fdt.dt, 0, totalsize);
+
+	fdt.dt_nextofs = ofs;
+
+	__of_flatten_dtb(&fdt, node, 1);
+
 	memreserve = of_find_node_by_name(node, "memreserve");
 	if (memreserve) {
 		const void *entries = of_get_property(memreserve, "reg", &len);
@@ -491,32 +539,29 @@ void *of_flatten_dtb(struct device_node *node)
 	nh->tag = cpu_to_fdt32(FDT_END);
 	fdt.dt_nextofs = dt_next_ofs(fdt.dt_nextofs, sizeof(struct fdt_node_header));
 
-	header.off_dt_struct = cpu_to_fdt32(ofs);
-	header.size_dt_struct = cpu_to_fdt32(fdt.dt_nextofs - ofs);
-
-	header.off_dt_strings = cpu_to_fdt32(fdt.dt_nextofs);
-	header.size_dt_strings = cpu_to_fdt32(fdt.str_nextofs);
+	for (i = 0; i < fdt.str_hash_size; i++) {
+		struct fdt_string *s = &fdt.str_hash[i];
 
-	if (fdt.dt_size - fdt.dt_nextofs < fdt.str_nextofs) {
-		fdt.dt = memalign_realloc(fdt.dt, fdt.dt_size,
-				fdt.dt_nextofs + fdt.str_nextofs);
-		if (!fdt.dt)
-			goto out_free;
+		if (s->name)
+			strcpy(fdt.dt + fdt.str_start + s->ofs, s->name);
 	}
 
-	memcpy(fdt.dt + fdt.dt_nextofs, fdt.strings, fdt.str_nextofs);
+	header.off_dt_struct = cpu_to_fdt32(ofs);
+	header.size_dt_struct = cpu_to_fdt32(fdt.dt_nextofs - ofs);
+
+	header.off_dt_strings = cpu_to_fdt32(fdt.str_start);
+	header.size_dt_strings = cpu_to_fdt32(fdt.str_size);
 
-	header.totalsize = cpu_to_fdt32(fdt.dt_nextofs + fdt.str_nextofs);
+	header.totalsize = cpu_to_fdt32(totalsize);
 
 	memcpy(fdt.dt, &header, sizeof(header));
 
-	free(fdt.strings);
+	free(fdt.str_hash);
 
 	return fdt.dt;
 
 out_free:
-	free(fdt.strings);
-	free(fdt.dt);
+	free(fdt.str_hash);
 
 	return NULL;
 }
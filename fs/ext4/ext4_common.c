@@ -38,49 +38,126 @@
 
 #include "ext4_common.h"
 
-static struct ext4_extent_header *ext4fs_get_extent_block(struct ext2_data *data,
-		char *buf, struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+static int ext4fs_add_extents(struct ext2fs_node *node,
+		struct ext4_extent_header *eh, int level)
 {
+	struct ext2_data *data = node->data;
+	int log2_blksz = LOG2_EXT2_BLOCK_SIZE(data);
+	int blksz = EXT2_BLOCK_SIZE(data);
+	int entries = le16_to_cpu(eh->eh_entries);
 	struct ext4_extent_idx *index;
 	unsigned long long block;
-	struct ext_filesystem *fs = data->fs;
-	int blksz = EXT2_BLOCK_SIZE(data);
-	int i, ret;
+	char *buf;
+	int i, ret = 0;
 
-	while (1) {
-		index = (struct ext4_extent_idx *)(ext_block + 1);
+	if (le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC ||
+	    level > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
 
-		if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC)
-			return 0;
+	if (!eh->eh_depth) {
+		struct ext4_extent *extent = (struct ext4_extent *)(eh + 1);
 
-		if (ext_block->eh_depth == 0)
-			return ext_block;
-		i = -1;
-		do {
-			i++;
-			if (i >= le16_to_cpu(ext_block->eh_entries))
-				break;
-		} while (fileblock >= le32_to_cpu(index[i].ei_block));
+		node->extents = xrealloc(node->extents,
+				(node->num_extents + entries) *
+				sizeof(*node->extents));
 
-		if (--i < 0)
-			return 0;
+		for (i = 0; i < entries; i++) {
+			struct ext4fs_extent *e =
+				&node->extents[node->num_extents++];
+			unsigned int len = le16_to_cpu(extent[i].ee_len);
+
+			e->block = le32_to_cpu(extent[i].ee_block);
 
+			if (len > EXT4_EXT_INIT_MAX_LEN) {
+				/* uninitialized extent, reads as zeroes */
+				e->len = len - EXT4_EXT_INIT_MAX_LEN;
+				e->start = 0;
+			} else {
+				e->len = len;
+				e->start = le16_to_cpu(extent[i].ee_start_hi);
+				e->start = (e->start << 32) +
+					le32_to_cpu(extent[i].ee_start_lo);
+			}
+		}
+
+		return 0;
+	}
+
+	index = (struct ext4_extent_idx *)(eh + 1);
+	buf = xmalloc(blksz);
+
+	for (i = 0; i < entries; i++) {
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
 
-		ret = ext4fs_devread(fs, block << log2_blksz, 0, blksz, buf);
+		ret = ext4fs_devread(data->fs, block << log2_blksz, 0, blksz, buf);
 		if (ret)
-			return NULL;
+			break;
+
+		ret = ext4fs_add_extents(node,
+				(struct ext4_extent_header *)buf, level + 1);
+		if (ret)
+			break;
+	}
+
+	free(buf);
+
+	return ret;
+}
+
+/*
+ * Decode the whole extent tree of an inode once, so that the mapping of
+ * logical to physical blocks does not require walking the tree again.
+ */
+int ext4fs_get_extents(struct ext2fs_node *node)
+{
+	int ret;
+
+	if (node->extents)
+		return 0;
+
+	ret = ext4fs_add_extents(node,
+			(struct ext4_extent_header *)node->inode.b.blocks.dir_blocks,
+			0);
+	if (ret) {
+		pr_err("invalid extent block\n");
+		free(node->extents);
+		node->extents = NULL;
+		node->num_extents = 0;
+		return ret;
+	}
+
+	/* mark as read, even when the inode has no extents */
+	if (!node->extents)
+		node->extents = xzalloc(sizeof(*node->extents));
+
+	return 0;
+}
+
+/*
+ * Return the extent containing fileblock or, when fileblock is in a hole,
+ * the next extent after it. Returns NULL when there is no such extent.
+ */
+struct ext4fs_extent *ext4fs_find_extent(struct ext2fs_node *node,
+		uint32_t fileblock)
+{
+	int lo = 0, hi = node->num_extents, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (node->extents[mid].block + node->extents[mid].len <= fileblock)
+			lo = mid + 1;
 		else
-			ext_block = (struct ext4_extent_header *)buf;
+			hi = mid;
 	}
+
+	return lo < node->num_extents ? &node->extents[lo] : NULL;
 }
 
 static int ext4fs_blockgroup(struct ext2_data *data, int group,
 		struct ext2_block_group *blkgrp)
 {
-	long int blkno;
+	uint64_t blkno;
 	unsigned int blkoff, desc_per_blk;
 	struct ext_filesystem *fs = data->fs;
 	int desc_size = fs->gdsize;
@@ -91,7 +168,7 @@ static int ext4fs_blockgroup(struct ext2_data *data, int group,
 			group / desc_per_blk;
 	blkoff = (group % desc_per_blk) * desc_size;
 
-	dev_dbg(fs->dev, "read %d group descriptor (blkno %ld blkoff %u)\n",
+	dev_dbg(fs->dev, "read %d group descriptor (blkno %llu blkoff %u)\n",
 	      group, blkno, blkoff);
 
 	return ext4fs_devread(fs, blkno << LOG2_EXT2_BLOCK_SIZE(data),
@@ -104,7 +181,7 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	struct ext2_sblock *sblock = &data->sblock;
 	struct ext_filesystem *fs = data->fs;
 	int inodes_per_block, ret;
-	long int blkno;
+	uint64_t blkno;
 	unsigned int blkoff;
 
 	/* It is easier to calculate if the first inode is 0. */
@@ -115,8 +192,10 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 		return ret;
 
 	inodes_per_block = EXT2_BLOCK_SIZE(data) / fs->inodesz;
-	blkno = le32_to_cpu(blkgrp.inode_table_id) +
-	    (ino % le32_to_cpu(sblock->inodes_per_group)) / inodes_per_block;
+	blkno = le32_to_cpu(blkgrp.inode_table_id);
+	if (fs->gdsize >= 64)
+		blkno |= (uint64_t)le32_to_cpu(blkgrp.inode_table_id_high) << 32;
+	blkno += (ino % le32_to_cpu(sblock->inodes_per_group)) / inodes_per_block;
 	blkoff = (ino % inodes_per_block) * fs->inodesz;
 	/* Read the inode. */
 	ret = ext4fs_devread(fs, blkno << LOG2_EXT2_BLOCK_SIZE(data), blkoff,
@@ -128,7 +207,7 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 }
 
 static int ext4fs_get_indir_block(struct ext2fs_node *node,
-				struct ext4fs_indir_block *indir, int blkno)
+				struct ext4fs_indir_block *indir, uint64_t blkno)
 {
 	struct ext_filesystem *fs = node->data->fs;
 	int blksz;
@@ -143,21 +222,23 @@ static int ext4fs_get_indir_block(struct ext2fs_node *node,
 	if (ret) {
 		dev_err(fs->dev, "** SI ext2fs read block (indir 1)"
 			"failed. **\n");
+		indir->blkno = 0;
 		return ret;
 	}
 
+	indir->blkno = blkno;
+
 	return 0;
 }
 
-long int read_allocated_block(struct ext2fs_node *node, int fileblock)
+long long read_allocated_block(struct ext2fs_node *node, uint32_t fileblock)
 {
-	long int blknr;
+	long long blknr;
 	int blksz;
 	int log2_blksz;
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	struct ext2_inode *inode = &node->inode;
 	struct ext2_data *data = node->data;
 	int ret;
@@ -167,47 +248,17 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 	log2_blksz = LOG2_EXT2_BLOCK_SIZE(node->data);
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		char *buf = zalloc(blksz);
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i = -1;
-
-		if (!buf)
-			return -ENOMEM;
-
-		ext_block = ext4fs_get_extent_block(node->data, buf,
-				(struct ext4_extent_header *)inode->b.blocks.dir_blocks,
-				fileblock, log2_blksz);
-		if (!ext_block) {
-			pr_err("invalid extent block\n");
-			free(buf);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
-
-		do {
-			i++;
-			if (i >= le16_to_cpu(ext_block->eh_entries))
-				break;
-		} while (fileblock >= le32_to_cpu(extent[i].ee_block));
+		struct ext4fs_extent *extent;
 
-		if (--i >= 0) {
-			fileblock -= le32_to_cpu(extent[i].ee_block);
-			if (fileblock >= le16_to_cpu(extent[i].ee_len)) {
-				free(buf);
-				return 0;
-			}
+		ret = ext4fs_get_extents(node);
+		if (ret)
+			return ret;
 
-			start = le16_to_cpu(extent[i].ee_start_hi);
-			start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-			free(buf);
-			return fileblock + start;
-		}
+		extent = ext4fs_find_extent(node, fileblock);
+		if (!extent || fileblock < extent->block || !extent->start)
+			return 0;
 
-		free(buf);
-		return -EIO;
+		return extent->start + fileblock - extent->block;
 	}
 
 	if (fileblock < INDIRECT_BLOCKS) {
@@ -216,7 +267,7 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 	} else if (fileblock < (INDIRECT_BLOCKS + (blksz / 4))) {
 		/* Indirect. */
 		ret = ext4fs_get_indir_block(node, &data->indir1,
-				le32_to_cpu(inode->b.blocks.indir_block) << log2_blksz);
+				(uint64_t)le32_to_cpu(inode->b.blocks.indir_block) << log2_blksz);
 		if (ret)
 			return ret;
 		blknr = le32_to_cpu(data->indir1.data[fileblock - INDIRECT_BLOCKS]);
@@ -227,12 +278,12 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 		long int rblock = fileblock - (INDIRECT_BLOCKS + blksz / 4);
 
 		ret = ext4fs_get_indir_block(node, &data->indir1,
-				le32_to_cpu(inode->b.blocks.double_indir_block) << log2_blksz);
+				(uint64_t)le32_to_cpu(inode->b.blocks.double_indir_block) << log2_blksz);
 		if (ret)
 			return ret;
 
 		ret = ext4fs_get_indir_block(node, &data->indir2,
-				le32_to_cpu(data->indir1.data[rblock / perblock]) << log2_blksz);
+				(uint64_t)le32_to_cpu(data->indir1.data[rblock / perblock]) << log2_blksz);
 		if (ret)
 			return ret;
 
@@ -245,17 +296,18 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 		perblock_parent = ((blksz / 4) * (blksz / 4));
 
 		ret = ext4fs_get_indir_block(node, &data->indir1,
-				le32_to_cpu(inode->b.blocks.triple_indir_block) << log2_blksz);
+				(uint64_t)le32_to_cpu(inode->b.blocks.triple_indir_block) << log2_blksz);
 		if (ret)
 			return ret;
 
 		ret = ext4fs_get_indir_block(node, &data->indir2,
-				le32_to_cpu(data->indir1.data[rblock / perblock_parent]) << log2_blksz);
+				(uint64_t)le32_to_cpu(data->indir1.data[rblock / perblock_parent]) << log2_blksz);
 		if (ret)
 			return ret;
 
 		ret = ext4fs_get_indir_block(node, &data->indir3,
-				le32_to_cpu(data->indir2.data[rblock / perblock_child]) << log2_blksz);
+				(uint64_t)le32_to_cpu(data->indir2.data[(rblock / perblock_child) %
+					perblock_child]) << log2_blksz);
 		if (ret)
 			return ret;
 
@@ -557,6 +609,7 @@ fail:
 
 void ext4fs_umount(struct ext_filesystem *fs)
 {
+	free(fs->data->diropen.extents);
 	free(fs->data->indir1.data);
 	free(fs->data->indir2.data);
 	free(fs->data->indir3.data);
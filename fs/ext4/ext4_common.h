@@ -36,6 +36,19 @@
 #include "ext4fs.h"
 #include "ext_common.h"
 
+/*
+ * Like Linux' ext4_isize(): only regular files use size_high, for other
+ * inodes it is the former i_dir_acl, which may be set on ext2/3.
+ */
+static inline loff_t ext4fs_inode_size(struct ext2_inode *inode)
+{
+	if ((le16_to_cpu(inode->mode) & FILETYPE_INO_MASK) != FILETYPE_INO_REG)
+		return le32_to_cpu(inode->size);
+
+	return ((loff_t)le32_to_cpu(inode->size_high) << 32) |
+		le32_to_cpu(inode->size);
+}
+
 static inline void *zalloc(size_t size)
 {
 	void *p = dma_alloc(size);
@@ -48,11 +61,14 @@ static inline void *zalloc(size_t size)
 
 int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
-int ext4fs_read_file(struct ext2fs_node *node, int pos,
+int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		unsigned int len, char *buf);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int *foundtype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
+int ext4fs_get_extents(struct ext2fs_node *node);
+struct ext4fs_extent *ext4fs_find_extent(struct ext2fs_node *node,
+			uint32_t fileblock);
 
 #endif
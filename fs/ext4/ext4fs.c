@@ -38,8 +38,70 @@
 
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 {
-	if ((node != &node->data->diropen) && (node != currroot))
+	if ((node != &node->data->diropen) && (node != currroot)) {
+		free(node->extents);
 		free(node);
+	}
+}
+
+/*
+ * Read from an extent mapped inode. Each contiguous run of blocks is read
+ * with a single ext4fs_devread().
+ */
+static int ext4fs_read_file_extents(struct ext2fs_node *node, loff_t pos,
+		unsigned int len, char *buf)
+{
+	int log2blocksize = LOG2_EXT2_BLOCK_SIZE(node->data);
+	int log2bytes = log2blocksize + DISK_SECTOR_BITS;
+	int blocksize = 1 << log2bytes;
+	struct ext_filesystem *fs = node->data->fs;
+	struct ext4fs_extent *extent;
+	unsigned int done = 0;
+	int ret;
+
+	ret = ext4fs_get_extents(node);
+	if (ret)
+		return ret;
+
+	while (done < len) {
+		uint32_t fileblock = (pos + done) >> log2bytes;
+		unsigned int blockoff = (pos + done) & (blocksize - 1);
+		uint64_t now = len - done;
+		uint64_t avail;
+
+		extent = ext4fs_find_extent(node, fileblock);
+
+		if (extent && fileblock >= extent->block) {
+			avail = (uint64_t)(extent->block + extent->len - fileblock) *
+				blocksize - blockoff;
+			now = min(now, avail);
+
+			if (extent->start) {
+				uint64_t blknr = extent->start + fileblock -
+					extent->block;
+
+				ret = ext4fs_devread(fs, blknr << log2blocksize,
+						blockoff, now, buf + done);
+				if (ret)
+					return ret;
+			} else {
+				memset(buf + done, 0, now);
+			}
+		} else {
+			/* hole, up to the next extent */
+			if (extent) {
+				avail = (uint64_t)(extent->block - fileblock) *
+					blocksize - blockoff;
+				now = min(now, avail);
+			}
+
+			memset(buf + done, 0, now);
+		}
+
+		done += now;
+	}
+
+	return len;
 }
 
 /*
@@ -47,32 +109,38 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
  */
-int ext4fs_read_file(struct ext2fs_node *node, int pos,
+int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		unsigned int len, char *buf)
 {
-	int i;
-	int blockcnt;
+	uint32_t i;
+	uint32_t blockcnt;
 	int log2blocksize = LOG2_EXT2_BLOCK_SIZE(node->data);
-	int blocksize = 1 << (log2blocksize + DISK_SECTOR_BITS);
-	unsigned int filesize = le32_to_cpu(node->inode.size);
-	int previous_block_number = -1;
-	int delayed_start = 0;
+	int log2bytes = log2blocksize + DISK_SECTOR_BITS;
+	int blocksize = 1 << log2bytes;
+	loff_t filesize = ext4fs_inode_size(&node->inode);
+	long long previous_block_number = -1;
+	uint64_t delayed_start = 0;
 	int delayed_extent = 0;
 	int delayed_skipfirst = 0;
-	int delayed_next = 0;
+	uint64_t delayed_next = 0;
 	char *delayed_buf = NULL;
 	short ret;
 	struct ext_filesystem *fs = node->data->fs;
 
 	/* Adjust len so it we can't read past the end of the file. */
-	if (len > filesize)
-		len = filesize;
+	if (pos >= filesize)
+		return 0;
+	if (len > filesize - pos)
+		len = filesize - pos;
+
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+		return ext4fs_read_file_extents(node, pos, len, buf);
 
-	blockcnt = ((len + pos) + blocksize - 1) / blocksize;
+	blockcnt = ((len + pos) + blocksize - 1) >> log2bytes;
 
-	for (i = pos / blocksize; i < blockcnt; i++) {
-		int blknr;
-		int blockoff = pos % blocksize;
+	for (i = pos >> log2bytes; i < blockcnt; i++) {
+		long long blknr;
+		int blockoff = pos & (blocksize - 1);
 		int blockend = blocksize;
 		int skipfirst = 0;
 		blknr = read_allocated_block(node, i);
@@ -83,7 +151,7 @@ int ext4fs_read_file(struct ext2fs_node *node, int pos,
 
 		/* Last block.  */
 		if (i == blockcnt - 1) {
-			blockend = (len + pos) % blocksize;
+			blockend = (len + pos) & (blocksize - 1);
 
 			/* The last portion is exactly blocksize. */
 			if (!blockend)
@@ -91,7 +159,7 @@ int ext4fs_read_file(struct ext2fs_node *node, int pos,
 		}
 
 		/* First block. */
-		if (i == pos / blocksize) {
+		if (i == pos >> log2bytes) {
 			skipfirst = blockoff;
 			blockend -= skipfirst;
 		}
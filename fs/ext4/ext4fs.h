@@ -26,6 +26,8 @@
 
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
 #define EXT4_EXT_MAGIC			0xf30a
+#define EXT4_EXT_MAX_DEPTH		5
+#define EXT4_EXT_INIT_MAX_LEN		(1 << 15)
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
@@ -124,7 +126,7 @@ int ext4fs_mount(struct ext_filesystem *fs);
 void ext4fs_umount(struct ext_filesystem *fs);
 char *ext4fs_read_symlink(struct ext2fs_node *node);
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot);
-int ext4fs_devread(struct ext_filesystem *fs, int sector, int byte_offset, int byte_len, char *buf);
-long int read_allocated_block(struct ext2fs_node *node, int fileblock);
+int ext4fs_devread(struct ext_filesystem *fs, uint64_t sector, int byte_offset, int byte_len, char *buf);
+long long read_allocated_block(struct ext2fs_node *node, uint32_t fileblock);
 
 #endif
@@ -30,15 +30,14 @@
 #include <fcntl.h>
 #include "ext4_common.h"
 
-int ext4fs_devread(struct ext_filesystem *fs, int __sector, int byte_offset,
+int ext4fs_devread(struct ext_filesystem *fs, uint64_t sector, int byte_offset,
 		int byte_len, char *buf)
 {
 	ssize_t size;
-	uint64_t sector = __sector;
 
 	size = cdev_read(fs->cdev, buf, byte_len, sector * SECTOR_SIZE + byte_offset, 0);
 	if (size < 0) {
-		dev_err(fs->dev, "read error at sector %d: %s\n", __sector,
+		dev_err(fs->dev, "read error at sector %llu: %s\n", sector,
 				strerror(-size));
 		return size;
 	}
@@ -56,7 +55,7 @@ static int ext_open(struct device_d *dev, FILE *file, const char *filename)
 	if (ret)
 		return ret;
 
-	file->size = le32_to_cpu(inode->inode.size);
+	file->size = ext4fs_inode_size(&inode->inode);
 	file->priv = inode;
 
 	return 0;
@@ -186,7 +185,7 @@ static int ext_stat(struct device_d *dev, const char *filename, struct stat *s)
 	if (ret)
 		return ret;
 
-	s->st_size = le32_to_cpu(node->inode.size);
+	s->st_size = ext4fs_inode_size(&node->inode);
 	s->st_mode = le16_to_cpu(node->inode.mode);
 
 	ext4fs_free_node(node, &fs->data->diropen);
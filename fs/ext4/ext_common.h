@@ -207,16 +207,26 @@ struct ext2_dirent {
 	__u8 filetype;
 };
 
+/* A decoded extent, start is 0 for uninitialized extents */
+struct ext4fs_extent {
+	uint32_t block;		/* first logical block */
+	uint32_t len;		/* number of blocks */
+	uint64_t start;		/* first physical block */
+};
+
 struct ext2fs_node {
 	struct ext2_data *data;
 	struct ext2_inode inode;
 	int ino;
 	int inode_read;
+	/* extents of an extent mapped inode, sorted by logical block */
+	struct ext4fs_extent *extents;
+	int num_extents;
 };
 
 struct ext4fs_indir_block {
 	int size;
-	int blkno;
+	uint64_t blkno;
 	uint32_t *data;
 };
 
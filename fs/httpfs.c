@@ -0,0 +1,752 @@
+/*
+ * httpfs.c - read only filesystem for files on a HTTP server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include <common.h>
+#include <driver.h>
+#include <clock.h>
+#include <fs.h>
+#include <errno.h>
+#include <init.h>
+#include <malloc.h>
+#include <poller.h>
+#include <linux/stat.h>
+#include <linux/err.h>
+#include <linux/sizes.h>
+#include <pico_stack.h>
+#include <pico_ipv4.h>
+#include <pico_socket.h>
+
+#define HTTP_PORT	80
+
+/* After this time without progress we will bail out */
+#define HTTP_TIMEOUT	(10 * SECOND)
+
+/* room for the status line and header fields of a response */
+#define HTTP_HDR_SIZE	SZ_4K
+
+/* TCP receive buffer, the advertised window is derived from it */
+#define HTTP_RCVBUF	SZ_256K
+
+/*
+ * Files are read with range requests. The first request after a seek asks
+ * for HTTP_RA_MIN bytes (or what the caller wants, if that is more), each
+ * request continuing the previous one asks for twice as much, up to
+ * HTTP_RA_MAX. When a response is abandoned because the caller seeked
+ * away, up to HTTP_DRAIN_MAX unread bytes are read and dropped to keep the
+ * connection, for more the connection is closed instead.
+ */
+#define HTTP_RA_MIN	SZ_64K
+#define HTTP_RA_MAX	SZ_4M
+#define HTTP_DRAIN_MAX	SZ_64K
+
+/* open() stats the file right before opening it, reuse the HEAD result */
+#define HTTP_STAT_CACHE_TIME	SECOND
+
+struct httpfs_priv {
+	struct pico_ip4 server;
+	uint16_t port;
+	char *root;
+	struct pico_socket *sock;
+	uint16_t events;
+	int keepalive;
+
+	/* response header, may be followed by the start of the body */
+	char hdr[HTTP_HDR_SIZE];
+	int hdr_len;
+	int hdr_pos;
+
+	/* body of the current response */
+	struct httpfs_file *owner;
+	loff_t body_pos;	/* file offset of the next body byte */
+	loff_t body_left;	/* -1: until the server closes the connection */
+
+	/* result of the last HEAD request */
+	char *stat_path;
+	loff_t stat_size;
+	uint64_t stat_time;
+};
+
+struct httpfs_file {
+	char *path;
+	loff_t size;
+	loff_t ra_next;
+	size_t ra;
+};
+
+struct http_response {
+	int status;
+	loff_t length;
+	loff_t range_start;
+	int close;
+	int chunked;
+};
+
+static void httpfs_wakeup(uint16_t ev, struct pico_socket *s)
+{
+	struct httpfs_priv *priv = s->priv;
+
+	if (priv)
+		priv->events |= ev;
+}
+
+static int httpfs_poll(void)
+{
+	/* not every architecture runs the pollers from ctrlc() */
+	poller_call();
+
+	if (ctrlc())
+		return -EINTR;
+
+	return 0;
+}
+
+static void httpfs_disconnect(struct httpfs_priv *priv)
+{
+	if (!priv->sock)
+		return;
+
+	priv->sock->priv = NULL;
+	pico_socket_close(priv->sock);
+	priv->sock = NULL;
+	priv->owner = NULL;
+	priv->body_left = 0;
+	priv->hdr_len = 0;
+	priv->hdr_pos = 0;
+}
+
+static int httpfs_connect(struct httpfs_priv *priv)
+{
+	uint32_t rcvbuf = HTTP_RCVBUF;
+	int nodelay = 1;
+	uint64_t start;
+	int ret;
+
+	priv->sock = pico_socket_open(PICO_PROTO_IPV4, PICO_PROTO_TCP,
+				      httpfs_wakeup);
+	if (!priv->sock)
+		return -ENOMEM;
+
+	priv->sock->priv = priv;
+	priv->events = 0;
+
+	pico_socket_setoption(priv->sock, PICO_SOCKET_OPT_RCVBUF, &rcvbuf);
+	pico_socket_setoption(priv->sock, PICO_TCP_NODELAY, &nodelay);
+
+	if (pico_socket_connect(priv->sock, &priv->server,
+				short_be(priv->port)) < 0) {
+		ret = -EHOSTUNREACH;
+		goto err;
+	}
+
+	start = get_time_ns();
+
+	while (!(priv->events & PICO_SOCK_EV_CONN)) {
+		if (priv->events & (PICO_SOCK_EV_ERR | PICO_SOCK_EV_CLOSE)) {
+			ret = -ECONNREFUSED;
+			goto err;
+		}
+
+		if (is_timeout(start, HTTP_TIMEOUT)) {
+			ret = -ETIMEDOUT;
+			goto err;
+		}
+
+		ret = httpfs_poll();
+		if (ret)
+			goto err;
+	}
+
+	return 0;
+err:
+	httpfs_disconnect(priv);
+	return ret;
+}
+
+static int httpfs_send(struct httpfs_priv *priv, const char *buf, int len)
+{
+	uint64_t start = get_time_ns();
+	int ret;
+
+	while (len) {
+		ret = pico_socket_write(priv->sock, buf, len);
+		if (ret < 0)
+			return -ECONNRESET;
+
+		if (ret) {
+			buf += ret;
+			len -= ret;
+			start = get_time_ns();
+			continue;
+		}
+
+		if (is_timeout(start, HTTP_TIMEOUT))
+			return -ETIMEDOUT;
+
+		ret = httpfs_poll();
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Read what is available, up to len bytes, waiting for at least one byte.
+ * Returns 0 when the server closed the connection.
+ */
+static int httpfs_recv(struct httpfs_priv *priv, void *buf, int len)
+{
+	uint64_t start = get_time_ns();
+	int ret;
+
+	while (1) {
+		ret = pico_socket_read(priv->sock, buf, len);
+		if (ret)
+			return ret < 0 ? -ECONNRESET : ret;
+
+		if (priv->events & PICO_SOCK_EV_ERR)
+			return -ECONNRESET;
+
+		if (priv->events & (PICO_SOCK_EV_CLOSE | PICO_SOCK_EV_FIN))
+			return 0;
+
+		if (is_timeout(start, HTTP_TIMEOUT))
+			return -ETIMEDOUT;
+
+		ret = httpfs_poll();
+		if (ret)
+			return ret;
+	}
+}
+
+static char *httpfs_next_line(char **str)
+{
+	char *line = *str, *end;
+
+	end = strstr(line, "\r\n");
+	if (end) {
+		*end = 0;
+		*str = end + 2;
+	} else {
+		*str = line + strlen(line);
+	}
+
+	return line;
+}
+
+static int httpfs_read_header(struct httpfs_priv *priv,
+			      struct http_response *resp)
+{
+	char *end, *str, *line, *val;
+	int ret;
+
+	priv->hdr_len = 0;
+	priv->hdr_pos = 0;
+
+	while (1) {
+		ret = httpfs_recv(priv, priv->hdr + priv->hdr_len,
+				  HTTP_HDR_SIZE - 1 - priv->hdr_len);
+		if (ret <= 0)
+			return ret ? ret : -ECONNRESET;
+
+		priv->hdr_len += ret;
+		priv->hdr[priv->hdr_len] = 0;
+
+		end = strstr(priv->hdr, "\r\n\r\n");
+		if (end)
+			break;
+
+		if (priv->hdr_len == HTTP_HDR_SIZE - 1)
+			return -EPROTO;
+	}
+
+	/* the body starts right after the empty line */
+	priv->hdr_pos = end + 4 - priv->hdr;
+	end[2] = 0;
+
+	str = priv->hdr;
+	line = httpfs_next_line(&str);
+
+	if (strncmp(line, "HTTP/1.", 7) || strlen(line) < 12)
+		return -EPROTO;
+
+	resp->status = simple_strtoul(line + 9, NULL, 10);
+	resp->length = -1;
+	resp->range_start = -1;
+	resp->close = line[7] == '0';
+	resp->chunked = 0;
+
+	while (*str) {
+		line = httpfs_next_line(&str);
+
+		val = strchr(line, ':');
+		if (!val)
+			continue;
+
+		*val++ = 0;
+		while (*val == ' ' || *val == '\t')
+			val++;
+
+		if (!strcasecmp(line, "Content-Length"))
+			resp->length = simple_strtoull(val, NULL, 10);
+		else if (!strcasecmp(line, "Content-Range") &&
+			 !strncmp(val, "bytes ", 6))
+			resp->range_start = simple_strtoull(val + 6, NULL, 10);
+		else if (!strcasecmp(line, "Connection"))
+			resp->close = !strcasecmp(val, "close");
+		else if (!strcasecmp(line, "Transfer-Encoding"))
+			resp->chunked = !!strcasecmp(val, "identity");
+	}
+
+	return 0;
+}
+
+/*
+ * Read up to len bytes of the current response body. Returns less than len
+ * only at the end of the body.
+ */
+static int httpfs_read_body(struct httpfs_priv *priv, void *buf, size_t len)
+{
+	size_t done;
+	int now;
+
+	if (priv->body_left >= 0)
+		len = min_t(loff_t, len, priv->body_left);
+
+	done = min_t(size_t, len, priv->hdr_len - priv->hdr_pos);
+	memcpy(buf, priv->hdr + priv->hdr_pos, done);
+	priv->hdr_pos += done;
+
+	while (done < len) {
+		now = httpfs_recv(priv, buf + done, min_t(size_t, len - done,
+							  SZ_1G));
+		if (now < 0)
+			return now;
+
+		if (!now) {
+			if (priv->body_left >= 0)
+				return -ECONNRESET;
+			priv->keepalive = 0;
+			priv->body_left = 0;
+			break;
+		}
+
+		done += now;
+	}
+
+	priv->body_pos += done;
+	if (priv->body_left > 0)
+		priv->body_left -= done;
+
+	return done;
+}
+
+static int httpfs_skip(struct httpfs_priv *priv, loff_t count)
+{
+	char buf[512];
+	int ret;
+
+	while (count) {
+		ret = httpfs_read_body(priv, buf, min_t(loff_t, count,
+							sizeof(buf)));
+		if (ret <= 0)
+			return ret ? ret : -ECONNRESET;
+
+		count -= ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Get rid of what is left of the current response, either by reading it or
+ * by closing the connection, whatever is cheaper.
+ */
+static void httpfs_abort(struct httpfs_priv *priv)
+{
+	priv->owner = NULL;
+
+	if (!priv->sock)
+		return;
+
+	if (!priv->keepalive || priv->body_left < 0 ||
+	    priv->body_left > HTTP_DRAIN_MAX ||
+	    httpfs_skip(priv, priv->body_left))
+		httpfs_disconnect(priv);
+}
+
+static int httpfs_request(struct httpfs_priv *priv, const char *method,
+			  const char *path, loff_t start, loff_t end,
+			  struct http_response *resp)
+{
+	char *range = NULL, *req;
+	int ret, reused, retry;
+
+	httpfs_abort(priv);
+
+	if (start >= 0)
+		range = basprintf("Range: bytes=%lld-%lld\r\n", start, end);
+
+	req = basprintf("%s %s%s HTTP/1.1\r\n"
+			"Host: %pI4:%u\r\n"
+			"User-Agent: barebox\r\n"
+			"%s\r\n",
+			method, priv->root, path, &priv->server.addr,
+			priv->port, range ? range : "");
+
+	for (retry = 0; retry < 2; retry++) {
+		reused = !!priv->sock;
+
+		if (!reused) {
+			ret = httpfs_connect(priv);
+			if (ret)
+				break;
+			priv->keepalive = 1;
+		}
+
+		ret = httpfs_send(priv, req, strlen(req));
+		if (!ret)
+			ret = httpfs_read_header(priv, resp);
+		if (!ret)
+			break;
+
+		httpfs_disconnect(priv);
+
+		/* the server may have closed an idle persistent connection */
+		if (!reused || ret != -ECONNRESET)
+			break;
+	}
+
+	free(req);
+	free(range);
+
+	if (ret)
+		return ret;
+
+	if (resp->chunked) {
+		pr_err("httpfs: chunked transfer encoding is not supported\n");
+		httpfs_disconnect(priv);
+		return -ENOSYS;
+	}
+
+	priv->keepalive = !resp->close;
+	priv->body_pos = 0;
+
+	if (!strcmp(method, "HEAD") || resp->status == 204 ||
+	    resp->status == 304)
+		priv->body_left = 0;
+	else
+		priv->body_left = resp->length;
+
+	if (priv->body_left < 0)
+		priv->keepalive = 0;
+
+	return 0;
+}
+
+static int httpfs_status_to_errno(int status)
+{
+	switch (status) {
+	case 200 ... 299:
+		return 0;
+	case 401:
+	case 403:
+		return -EACCES;
+	case 404:
+	case 410:
+		return -ENOENT;
+	default:
+		pr_debug("httpfs: server responded with status %d\n", status);
+		return -EIO;
+	}
+}
+
+static int httpfs_head(struct httpfs_priv *priv, const char *path,
+		       loff_t *size)
+{
+	struct http_response resp;
+	int ret;
+
+	if (priv->stat_path && !strcmp(priv->stat_path, path) &&
+	    !is_timeout(priv->stat_time, HTTP_STAT_CACHE_TIME)) {
+		*size = priv->stat_size;
+		return 0;
+	}
+
+	ret = httpfs_request(priv, "HEAD", path, -1, -1, &resp);
+	if (ret)
+		return ret;
+
+	ret = httpfs_status_to_errno(resp.status);
+	if (ret)
+		return ret;
+
+	*size = resp.length >= 0 ? resp.length : FILE_SIZE_STREAM;
+
+	free(priv->stat_path);
+	priv->stat_path = xstrdup(path);
+	priv->stat_size = *size;
+	priv->stat_time = get_time_ns();
+
+	return 0;
+}
+
+/*
+ * Issue a GET request for the data at pos and make it the current response.
+ * Returns 0 at end of file, 1 when body data is ready to be read.
+ */
+static int httpfs_get(struct httpfs_priv *priv, struct httpfs_file *hf,
+		      loff_t pos, size_t size)
+{
+	struct http_response resp;
+	loff_t end;
+	int ret;
+
+	if (hf->size != FILE_SIZE_STREAM && pos >= hf->size)
+		return 0;
+
+	if (pos != hf->ra_next)
+		hf->ra = HTTP_RA_MIN;
+
+	end = pos + max(size, hf->ra) - 1;
+	if (hf->size != FILE_SIZE_STREAM)
+		end = min(end, hf->size - 1);
+
+	hf->ra_next = end + 1;
+	hf->ra = min_t(size_t, hf->ra * 2, HTTP_RA_MAX);
+
+	ret = httpfs_request(priv, "GET", hf->path, pos, end, &resp);
+	if (ret)
+		return ret;
+
+	switch (resp.status) {
+	case 206:
+		if (resp.range_start != pos) {
+			httpfs_disconnect(priv);
+			return -EPROTO;
+		}
+		priv->body_pos = pos;
+		break;
+	case 200:
+		/*
+		 * The server ignored the range and sends the whole file. Skip
+		 * to pos and keep reading sequentially from this response.
+		 */
+		ret = httpfs_skip(priv, pos);
+		if (ret) {
+			httpfs_disconnect(priv);
+			return ret;
+		}
+		break;
+	case 416:
+		return 0;
+	default:
+		return httpfs_status_to_errno(resp.status);
+	}
+
+	priv->owner = hf;
+
+	return 1;
+}
+
+static int httpfs_read(struct device_d *dev, FILE *f, void *buf, size_t insize)
+{
+	struct httpfs_priv *priv = dev->priv;
+	struct httpfs_file *hf = f->priv;
+	loff_t pos = f->pos;
+	size_t done = 0;
+	int ret;
+
+	while (done < insize) {
+		if (priv->owner != hf || priv->body_pos != pos + done ||
+		    !priv->body_left) {
+			ret = httpfs_get(priv, hf, pos + done, insize - done);
+			if (ret < 0)
+				return ret;
+			if (!ret)
+				break;
+		}
+
+		ret = httpfs_read_body(priv, buf + done, insize - done);
+		if (ret < 0) {
+			httpfs_disconnect(priv);
+			return ret;
+		}
+		if (!ret)
+			break;
+
+		done += ret;
+	}
+
+	return done;
+}
+
+static loff_t httpfs_lseek(struct device_d *dev, FILE *f, loff_t pos)
+{
+	/* the next read() requests the data at the new position */
+	f->pos = pos;
+
+	return pos;
+}
+
+static int httpfs_open(struct device_d *dev, FILE *f, const char *filename)
+{
+	struct httpfs_priv *priv = dev->priv;
+	struct httpfs_file *hf;
+	int ret;
+
+	hf = xzalloc(sizeof(*hf));
+	hf->path = xstrdup(filename);
+	hf->ra = HTTP_RA_MIN;
+
+	ret = httpfs_head(priv, filename, &hf->size);
+	if (ret) {
+		free(hf->path);
+		free(hf);
+		return ret;
+	}
+
+	f->priv = hf;
+	f->size = hf->size;
+
+	return 0;
+}
+
+static int httpfs_close(struct device_d *dev, FILE *f)
+{
+	struct httpfs_priv *priv = dev->priv;
+	struct httpfs_file *hf = f->priv;
+
+	/* the rest of the response is dealt with by the next request */
+	if (priv->owner == hf)
+		priv->owner = NULL;
+
+	free(hf->path);
+	free(hf);
+
+	return 0;
+}
+
+static DIR *httpfs_opendir(struct device_d *dev, const char *pathname)
+{
+	/* HTTP has no directory listings */
+	return NULL;
+}
+
+static int httpfs_stat(struct device_d *dev, const char *filename,
+		       struct stat *s)
+{
+	struct httpfs_priv *priv = dev->priv;
+	loff_t size;
+	int ret;
+
+	if (!*filename || !strcmp(filename, "/")) {
+		s->st_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO;
+		s->st_size = 0;
+		return 0;
+	}
+
+	ret = httpfs_head(priv, filename, &size);
+	if (ret)
+		return ret;
+
+	s->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+	s->st_size = size;
+
+	return 0;
+}
+
+/*
+ * The backingstore is <server>[:<port>][/<path>], where server is an IPv4
+ * address and path a prefix for all requests.
+ */
+static int httpfs_probe(struct device_d *dev)
+{
+	struct fs_device_d *fsdev = dev_to_fs_device(dev);
+	struct httpfs_priv *priv;
+	uint32_t addr;
+	char *str, *p;
+	int ret;
+
+	priv = xzalloc(sizeof(*priv));
+	str = xstrdup(fsdev->backingstore);
+
+	p = strchr(str, '/');
+	if (p) {
+		priv->root = xstrdup(p);
+		*p = 0;
+		p = priv->root + strlen(priv->root) - 1;
+		while (p >= priv->root && *p == '/')
+			*p-- = 0;
+	} else {
+		priv->root = xstrdup("");
+	}
+
+	priv->port = HTTP_PORT;
+
+	p = strchr(str, ':');
+	if (p) {
+		*p++ = 0;
+		priv->port = simple_strtoul(p, NULL, 10);
+	}
+
+	if (!priv->port || pico_string_to_ipv4(str, &addr)) {
+		dev_err(dev, "invalid server address: %s\n",
+			fsdev->backingstore);
+		ret = -EINVAL;
+		goto err;
+	}
+
+	priv->server.addr = addr;
+	free(str);
+	dev->priv = priv;
+
+	return 0;
+err:
+	free(str);
+	free(priv->root);
+	free(priv);
+
+	return ret;
+}
+
+static void httpfs_remove(struct device_d *dev)
+{
+	struct httpfs_priv *priv = dev->priv;
+
+	httpfs_disconnect(priv);
+	free(priv->stat_path);
+	free(priv->root);
+	free(priv);
+}
+
+static struct fs_driver_d httpfs_driver = {
+	.open      = httpfs_open,
+	.close     = httpfs_close,
+	.read      = httpfs_read,
+	.lseek     = httpfs_lseek,
+	.opendir   = httpfs_opendir,
+	.stat      = httpfs_stat,
+	.flags     = 0,
+	.drv = {
+		.probe  = httpfs_probe,
+		.remove = httpfs_remove,
+		.name = "httpfs",
+	}
+};
+
+static int httpfs_init(void)
+{
+	return register_fs_driver(&httpfs_driver);
+}
+coredevice_initcall(httpfs_init);
@@ -32,10 +32,10 @@
 #include <init.h>
 #include <linux/stat.h>
 #include <linux/err.h>
-#include <kfifo.h>
 #include <linux/sizes.h>
 #include <byteorder.h>
 #include <globalvar.h>
+#include <magicvar.h>
 #include <parseopt.h>
 
 #define SUNRPC_PORT     111
@@ -57,6 +57,7 @@
 #define NFSPROC3_READLINK	5
 #define NFSPROC3_READ		6
 #define NFSPROC3_READDIR	16
+#define NFSPROC3_FSINFO		19
 
 #define NFS3_FHSIZE      64
 #define NFS3_COOKIEVERFSIZE	8
@@ -127,6 +128,21 @@ struct rpc_reply {
 #define NFS_TIMEOUT	(2 * SECOND)
 #define NFS_MAX_RESEND	5
 
+/* lower limit for the adaptive READ retransmission timeout */
+#define NFS_MIN_TIMEOUT	(50 * MSECOND)
+
+/*
+ * Largest READ payload which fits into a single ethernet frame: 1500 bytes
+ * MTU minus IP and UDP header, RPC reply header and a READ3resok with
+ * file attributes (26 words). Bigger replies are IP fragmented and can only
+ * be used with CONFIG_NET_IP_REASSEMBLY.
+ */
+#define NFS_MTU_RSIZE	(1500 - sizeof(struct iphdr) - sizeof(struct udphdr) - \
+			 sizeof(struct rpc_reply) - 26 * 4)
+
+#define NFS_MAX_RSIZE	SZ_32K
+#define NFS_MAX_WINDOW	32
+
 struct nfs_priv {
 	struct net_connection *con;
 	IPaddr_t server;
@@ -138,10 +154,42 @@ struct nfs_priv {
 	uint32_t rpc_id;
 	uint32_t rootfh_len;
 	char rootfh[NFS3_FHSIZE];
+	uint32_t rsize;
+	struct nfs_read_ctx *read_ctx;
+	/* smoothed round trip time and its variation for READ requests */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+};
+
+/* A READ request in flight */
+struct nfs_read_slot {
+	uint32_t xid;
+	uint64_t offset;
+	uint32_t count;
+	uint64_t sent;
+	int tries;
+	unsigned busy:1;
+	unsigned resend:1;
+};
+
+/*
+ * State of a pipelined read: up to window READ requests are in flight,
+ * replies are copied to their place in buf in whatever order they arrive.
+ */
+struct nfs_read_ctx {
+	struct file_priv *priv;
+	void *buf;
+	uint64_t pos;		/* file offset of buf */
+	uint64_t end;		/* end of the requested range or EOF */
+	uint64_t next;		/* next offset to request */
+	int pending;
+	int err;
+	int window;
+	struct nfs_read_slot slots[NFS_MAX_WINDOW];
 };
 
 struct file_priv {
-	struct kfifo *fifo;
 	void *buf;
 	uint32_t filefh_len;
 	char filefh[NFS3_FHSIZE];
@@ -150,6 +198,9 @@ struct file_priv {
 
 static uint64_t nfs_timer_start;
 
+static int nfs_rsize = NFS_MAX_RSIZE;
+static int nfs_window = 8;
+
 static int nfs_state;
 #define STATE_DONE			1
 #define STATE_START			2
@@ -349,13 +400,12 @@ static int rpc_check_reply(unsigned char *pkt,
 
 	memcpy(&rpc, pkt, sizeof(rpc));
 
-	if (ntoh32(rpc.id) != rpc_id) {
-		if (rpc_id - ntoh32(rpc.id) == 1)
-			/* stale packet, wait a bit longer */
-			return 0;
-
-		return -EINVAL;
-	}
+	/*
+	 * Not the reply we are waiting for, e.g. a late answer to a
+	 * retransmitted or pipelined request. Ignore it.
+	 */
+	if (ntoh32(rpc.id) != rpc_id)
+		return -EAGAIN;
 
 	if (rpc.rstatus  ||
 	    rpc.verifier ||
@@ -376,21 +426,16 @@ static int rpc_check_reply(unsigned char *pkt,
 }
 
 /*
- * rpc_req - synchronous RPC request
+ * rpc_send - send a RPC call with transaction id @id
  */
-static int rpc_req(struct nfs_priv *npriv, int rpc_prog, int rpc_proc,
-		uint32_t *data, int datalen)
+static int rpc_send(struct nfs_priv *npriv, uint32_t id, int rpc_prog,
+		int rpc_proc, uint32_t *data, int datalen)
 {
 	struct rpc_call pkt;
 	unsigned short dport;
-	int ret;
 	unsigned char *payload = net_udp_get_payload(npriv->con);
-	int nfserr;
-	int tries = 0;
-
-	npriv->rpc_id++;
 
-	pkt.id = hton32(npriv->rpc_id);
+	pkt.id = hton32(id);
 	pkt.type = hton32(MSG_CALL);
 	pkt.rpcvers = hton32(2);	/* use RPC version 2 */
 	pkt.prog = hton32(rpc_prog);
@@ -414,9 +459,25 @@ static int rpc_req(struct nfs_priv *npriv, int rpc_prog, int rpc_proc,
 
 	npriv->con->udp->uh_dport = hton16(dport);
 
-again:
-	ret = net_udp_send(npriv->con,
+	return net_udp_send(npriv->con,
 			sizeof(pkt) + datalen * sizeof(uint32_t));
+}
+
+/*
+ * rpc_req - synchronous RPC request
+ */
+static int rpc_req(struct nfs_priv *npriv, int rpc_prog, int rpc_proc,
+		uint32_t *data, int datalen)
+{
+	int ret;
+	int nfserr;
+	int tries = 0;
+
+	npriv->rpc_id++;
+
+again:
+	ret = rpc_send(npriv, npriv->rpc_id, rpc_prog, rpc_proc,
+			data, datalen);
 
 	nfs_timer_start = get_time_ns();
 
@@ -443,6 +504,12 @@ again:
 			ret = nfserr;
 			break;
 		}
+
+		if (ret == -EAGAIN) {
+			/* keep waiting for our reply */
+			nfs_state = STATE_START;
+			nfs_packet = NULL;
+		}
 	}
 
 	return ret;
@@ -870,16 +937,77 @@ static void *nfs_readdirattr_req(struct file_priv *priv, struct nfs_dir *dir)
 }
 
 /*
- * nfs_read_req - Read File on NFS Server
+ * nfs_fsinfo_req - ask the server for the maximum READ size it supports
  */
-static int nfs_read_req(struct file_priv *priv, uint64_t offset,
-		uint32_t readlen)
+static void nfs_fsinfo_req(struct nfs_priv *npriv)
 {
 	uint32_t data[1024];
 	uint32_t *p;
-	int len;
+	uint32_t rtmax;
 	int ret;
-	uint32_t rlen, eof;
+
+	/*
+	 * struct FSINFO3args {
+	 * 	nfs_fh3 fsroot;
+	 * };
+	 *
+	 * struct FSINFO3resok {
+	 * 	post_op_attr obj_attributes;
+	 * 	uint32 rtmax;
+	 * 	uint32 rtpref;
+	 * 	...
+	 * };
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, npriv->rootfh_len, npriv->rootfh);
+
+	ret = rpc_req(npriv, PROG_NFS, NFSPROC3_FSINFO, data, p - data);
+	if (ret) {
+		debug("%s: failed with %d, using rsize %u\n", __func__, ret,
+				npriv->rsize);
+		return;
+	}
+
+	p = nfs_packet + sizeof(struct rpc_reply) + 4;
+	p = nfs_read_post_op_attr(p, NULL);
+
+	rtmax = ntoh32(net_read_uint32(p)) & ~3;
+	if (rtmax && rtmax < npriv->rsize)
+		npriv->rsize = rtmax;
+
+	debug("%s: rtmax %u, using rsize %u\n", __func__, rtmax, npriv->rsize);
+}
+
+/*
+ * Update the retransmission timeout from a round trip time sample, like
+ * TCP does (RFC 6298).
+ */
+static void nfs_rtt_sample(struct nfs_priv *npriv, uint64_t rtt)
+{
+	int64_t delta;
+
+	if (!npriv->srtt) {
+		npriv->srtt = rtt;
+		npriv->rttvar = rtt / 2;
+	} else {
+		delta = rtt - npriv->srtt;
+		npriv->srtt += delta / 8;
+		if (delta < 0)
+			delta = -delta;
+		npriv->rttvar += (delta - (int64_t)npriv->rttvar) / 4;
+	}
+
+	npriv->rto = clamp_t(uint64_t, npriv->srtt + 4 * npriv->rttvar,
+			     NFS_MIN_TIMEOUT, NFS_TIMEOUT);
+}
+
+static int nfs_read_send(struct nfs_read_ctx *rd, struct nfs_read_slot *slot)
+{
+	struct file_priv *priv = rd->priv;
+	uint32_t data[64];
+	uint32_t *p;
 
 	/*
 	 * struct READ3args {
@@ -887,67 +1015,216 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 * 	offset3 offset;
 	 * 	count3 count;
 	 * };
-	 *
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, priv->filefh_len, priv->filefh);
+	p = nfs_add_uint64(p, slot->offset);
+	p = nfs_add_uint32(p, slot->count);
+
+	slot->sent = get_time_ns();
+	slot->resend = 0;
+
+	return rpc_send(priv->npriv, slot->xid, PROG_NFS, NFSPROC3_READ,
+			data, p - data);
+}
+
+/*
+ * nfs_read_reply - handle a READ reply during a pipelined read
+ *
+ * Called from the network receive path, so only copy the data to its place
+ * in the read buffer. Requests which have to be sent again are marked and
+ * sent from nfs_read_req().
+ */
+static void nfs_read_reply(struct nfs_read_ctx *rd, void *pkt, int len)
+{
+	struct nfs_priv *npriv = rd->priv->npriv;
+	struct nfs_read_slot *slot = NULL;
+	struct rpc_reply rpc;
+	uint32_t *p, *end = pkt + len;
+	uint32_t rlen, eof;
+	int i, status;
+
+	if (len < sizeof(rpc) + 4)
+		return;
+
+	memcpy(&rpc, pkt, sizeof(rpc));
+
+	for (i = 0; i < rd->window; i++) {
+		if (rd->slots[i].busy && rd->slots[i].xid == ntoh32(rpc.id)) {
+			slot = &rd->slots[i];
+			break;
+		}
+	}
+
+	/* stale or duplicate reply */
+	if (!slot)
+		return;
+
+	if (rpc.rstatus || rpc.verifier || rpc.astatus) {
+		rd->err = -EINVAL;
+		return;
+	}
+
+	/*
 	 * struct READ3resok {
 	 * 	post_op_attr file_attributes;
 	 * 	count3 count;
 	 * 	bool eof;
 	 * 	opaque data<>;
 	 * };
-	 *
-	 * struct READ3resfail {
-	 * 	post_op_attr file_attributes;
-	 * };
-	 *
-	 * union READ3res switch (nfsstat3 status) {
-	 * case NFS3_OK:
-	 * 	READ3resok resok;
-	 * default:
-	 * 	READ3resfail resfail;
-	 * };
 	 */
-	p = &(data[0]);
-	p = rpc_add_credentials(p);
+	p = pkt + sizeof(rpc);
+	status = ntoh32(net_read_uint32(p++));
+	if (status) {
+		rd->err = -status;
+		return;
+	}
 
-	p = nfs_add_fh3(p, priv->filefh_len, priv->filefh);
-	p = nfs_add_uint64(p, offset);
-	p = nfs_add_uint32(p, readlen);
+	if (ntoh32(net_read_uint32(p++)))
+		p += 21;	/* fattr3 */
 
-	len = p - &(data[0]);
+	if (p + 3 > end)
+		goto bad;
 
-	ret = rpc_req(priv->npriv, PROG_NFS, NFSPROC3_READ, data, len);
-	if (ret)
-		return ret;
+	rlen = ntoh32(net_read_uint32(p));
+	eof = ntoh32(net_read_uint32(p + 1));
+	/* skip count, eof and the length embedded in opaque data */
+	p += 3;
+
+	if (rlen > slot->count || (void *)p + rlen > (void *)end)
+		goto bad;
+
+	memcpy(rd->buf + (slot->offset - rd->pos), p, rlen);
+
+	/* Karn's algorithm: only take samples from unambiguous replies */
+	if (!slot->tries)
+		nfs_rtt_sample(npriv, get_time_ns() - slot->sent);
+
+	if (eof) {
+		rd->end = min(rd->end, slot->offset + rlen);
+	} else if (rlen < slot->count) {
+		if (!rlen)
+			goto bad;
+
+		/* short read, ask for the rest */
+		slot->offset += rlen;
+		slot->count -= rlen;
+		slot->xid = ++npriv->rpc_id;
+		slot->tries = 0;
+		slot->resend = 1;
+		return;
+	}
 
-	p = nfs_packet + sizeof(struct rpc_reply) + 4;
+	slot->busy = 0;
+	rd->pending--;
 
-	p = nfs_read_post_op_attr(p, NULL);
+	return;
+bad:
+	rd->err = -EIO;
+}
 
-	rlen = ntoh32(net_read_uint32(p));
+/*
+ * nfs_read_req - Read File on NFS Server
+ *
+ * Reads size bytes at offset pos into buf. Up to nfs_window READ requests
+ * of rsize bytes are kept in flight, each with its own transaction id.
+ * Returns the number of bytes read, which is only less than size at the
+ * end of the file.
+ */
+static int nfs_read_req(struct file_priv *priv, uint64_t pos, void *buf,
+		size_t size)
+{
+	struct nfs_priv *npriv = priv->npriv;
+	struct nfs_read_ctx *rd;
+	struct nfs_read_slot *slot;
+	int i, ret;
+
+	rd = xzalloc(sizeof(*rd));
+	rd->priv = priv;
+	rd->buf = buf;
+	rd->pos = pos;
+	rd->next = pos;
+	rd->end = pos + size;
+	rd->window = clamp(nfs_window, 1, NFS_MAX_WINDOW);
+
+	if (!npriv->rto)
+		npriv->rto = NFS_TIMEOUT;
+
+	npriv->read_ctx = rd;
+
+	while (!rd->err) {
+		for (i = 0; i < rd->window; i++) {
+			slot = &rd->slots[i];
+
+			if (!slot->busy) {
+				if (rd->next >= rd->end)
+					continue;
+
+				slot->busy = 1;
+				slot->xid = ++npriv->rpc_id;
+				slot->offset = rd->next;
+				slot->count = min_t(uint64_t, npriv->rsize,
+						    rd->end - rd->next);
+				slot->tries = 0;
+				slot->resend = 1;
+				rd->next += slot->count;
+				rd->pending++;
+			} else if (!slot->resend &&
+				   is_timeout(slot->sent, npriv->rto)) {
+				if (++slot->tries == NFS_MAX_RESEND) {
+					rd->err = -ETIMEDOUT;
+					break;
+				}
+				/* back off until we get a new RTT sample */
+				npriv->rto = min_t(uint64_t, npriv->rto * 2,
+						   NFS_TIMEOUT);
+				slot->resend = 1;
+			}
+
+			if (slot->resend) {
+				ret = nfs_read_send(rd, slot);
+				if (ret < 0) {
+					rd->err = ret;
+					break;
+				}
+			}
+		}
 
-	/* skip over count */
-	p += 1;
+		if (!rd->pending || rd->err)
+			break;
 
-	eof = ntoh32(net_read_uint32(p));
+		if (ctrlc()) {
+			rd->err = -EINTR;
+			break;
+		}
 
-	/*
-	 * skip over eof and count embedded in the representation of data
-	 * assuming it equals rlen above.
-	 */
-	p += 2;
+		net_poll();
+	}
 
-	if (readlen && !rlen && !eof)
-		return -EIO;
+	npriv->read_ctx = NULL;
 
-	kfifo_put(priv->fifo, (char *)p, rlen);
+	ret = rd->err;
+	if (!ret)
+		ret = min_t(uint64_t, rd->end, pos + size) - pos;
 
-	return 0;
+	free(rd);
+
+	return ret;
 }
 
 static void nfs_handler(void *ctx, char *packet, unsigned len)
 {
+	struct nfs_priv *npriv = ctx;
 	char *pkt = net_eth_to_udp_payload(packet);
 
+	if (npriv->read_ctx) {
+		nfs_read_reply(npriv->read_ctx, pkt,
+			       net_eth_to_udplen(packet));
+		return;
+	}
+
 	nfs_state = STATE_DONE;
 	nfs_packet = pkt;
 	nfs_len = len;
@@ -1031,9 +1308,6 @@ out:
 
 static void nfs_do_close(struct file_priv *priv)
 {
-	if (priv->fifo)
-		kfifo_free(priv->fifo);
-
 	free(priv);
 }
 
@@ -1149,12 +1423,6 @@ static int nfs_open(struct device_d *dev, FILE *file, const char *filename)
 	file->priv = priv;
 	file->size = s.st_size;
 
-	priv->fifo = kfifo_alloc(1024);
-	if (!priv->fifo) {
-		free(priv);
-		return -ENOMEM;
-	}
-
 	return 0;
 }
 
@@ -1177,24 +1445,15 @@ static int nfs_read(struct device_d *dev, FILE *file, void *buf, size_t insize)
 {
 	struct file_priv *priv = file->priv;
 
-	if (insize > 1024)
-		insize = 1024;
-
-	if (insize && !kfifo_len(priv->fifo)) {
-		int ret = nfs_read_req(priv, file->pos, insize);
-		if (ret)
-			return ret;
-	}
+	if (!insize)
+		return 0;
 
-	return kfifo_get(priv->fifo, buf, insize);
+	return nfs_read_req(priv, file->pos, buf, insize);
 }
 
 static loff_t nfs_lseek(struct device_d *dev, FILE *file, loff_t pos)
 {
-	struct file_priv *priv = file->priv;
-
 	file->pos = pos;
-	kfifo_reset(priv->fifo);
 
 	return file->pos;
 }
@@ -1410,6 +1669,12 @@ static int nfs_probe(struct device_d *dev)
 		goto err2;
 	}
 
+	if (IS_ENABLED(CONFIG_NET_IP_REASSEMBLY))
+		npriv->rsize = clamp(nfs_rsize, 4, NFS_MAX_RSIZE) & ~3;
+	else
+		npriv->rsize = clamp(nfs_rsize, 4, (int)NFS_MTU_RSIZE) & ~3;
+	nfs_fsinfo_req(npriv);
+
 	nfs_set_rootarg(npriv, fsdev);
 
 	free(tmp);
@@ -1467,7 +1732,14 @@ static int nfs_init(void)
 	rootnfsopts = xstrdup("v3,tcp");
 
 	globalvar_add_simple_string("linux.rootnfsopts", &rootnfsopts);
+	globalvar_add_simple_int("nfs.rsize", &nfs_rsize, "%d");
+	globalvar_add_simple_int("nfs.window", &nfs_window, "%d");
 
 	return register_fs_driver(&nfs_driver);
 }
 coredevice_initcall(nfs_init);
+
+BAREBOX_MAGICVAR_NAMED(global_nfs_rsize, global.nfs.rsize,
+		"Maximum size of NFS READ requests in bytes");
+BAREBOX_MAGICVAR_NAMED(global_nfs_window, global.nfs.window,
+		"Number of NFS READ requests kept in flight");
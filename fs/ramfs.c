@@ -25,13 +25,22 @@
 #include <command.h>
 #include <errno.h>
 #include <linux/stat.h>
+#include <linux/sizes.h>
 #include <xfuncs.h>
 
 #define CHUNK_SIZE	(4096 * 2)
+/* Upper limit for the chunks allocated when a file grows piecewise */
+#define CHUNK_SIZE_MAX	SZ_4M
 
+/*
+ * File data is stored in an array of chunks sorted by their file offset.
+ * Chunks are allocated as large as possible, so that even big files only
+ * consist of a few chunks.
+ */
 struct ramfs_chunk {
 	char *data;
-	struct ramfs_chunk *next;
+	unsigned long ofs;
+	unsigned long size;
 };
 
 struct ramfs_inode {
@@ -45,11 +54,12 @@ struct ramfs_inode {
 	struct handle_d *handle;
 
 	ulong size;
-	struct ramfs_chunk *data;
+	struct ramfs_chunk *chunks;
+	int num_chunks;
+	ulong alloc_size;	/* sum of the sizes of all chunks */
 
-	/* Points to recently used chunk */
+	/* Index of recently used chunk */
 	int recent_chunk;
-	struct ramfs_chunk *recent_chunkp;
 };
 
 struct ramfs_priv {
@@ -132,30 +142,87 @@ out:
 	return node;
 }
 
-static int chunks = 0;
+static void ramfs_put_chunks(struct ramfs_inode *node)
+{
+	int i;
 
-static struct ramfs_chunk *ramfs_get_chunk(void)
+	for (i = 0; i < node->num_chunks; i++)
+		free(node->chunks[i].data);
+
+	free(node->chunks);
+	node->chunks = NULL;
+	node->num_chunks = 0;
+	node->alloc_size = 0;
+	node->recent_chunk = 0;
+}
+
+static void ramfs_add_chunk(struct ramfs_inode *node, char *data,
+			    unsigned long size)
 {
-	struct ramfs_chunk *data = malloc(sizeof(struct ramfs_chunk));
-	if (!data)
-		return NULL;
+	struct ramfs_chunk *chunk;
 
-	data->data = malloc(CHUNK_SIZE);
-	if (!data->data) {
-		free(data);
-		return NULL;
+	node->chunks = xrealloc(node->chunks,
+			(node->num_chunks + 1) * sizeof(*node->chunks));
+
+	chunk = &node->chunks[node->num_chunks++];
+	chunk->data = data;
+	chunk->ofs = node->alloc_size;
+	chunk->size = size;
+
+	node->alloc_size += size;
+}
+
+/*
+ * Grow the allocated space of a file to at least size bytes. When growing
+ * a file piecewise the chunk size doubles up to CHUNK_SIZE_MAX. Smaller
+ * chunks are used when memory is too fragmented for big allocations.
+ */
+static int ramfs_grow(struct ramfs_inode *node, unsigned long size)
+{
+	unsigned long chunksize;
+	char *data;
+
+	chunksize = max(size - node->alloc_size,
+			min(node->alloc_size, (unsigned long)CHUNK_SIZE_MAX));
+	chunksize = ALIGN(chunksize, CHUNK_SIZE);
+
+	while (node->alloc_size < size) {
+		while (1) {
+			data = malloc(chunksize);
+			if (data || chunksize == CHUNK_SIZE)
+				break;
+			chunksize = ALIGN(chunksize / 2, CHUNK_SIZE);
+		}
+
+		if (!data)
+			return -ENOMEM;
+
+		ramfs_add_chunk(node, data, chunksize);
 	}
-	data->next = NULL;
-	chunks++;
 
-	return data;
+	return 0;
 }
 
-static void ramfs_put_chunk(struct ramfs_chunk *data)
+/* Free the chunks which are completely beyond size */
+static void ramfs_shrink(struct ramfs_inode *node, unsigned long size)
 {
-	free(data->data);
-	free(data);
-	chunks--;
+	struct ramfs_chunk *chunk;
+
+	while (node->num_chunks) {
+		chunk = &node->chunks[node->num_chunks - 1];
+		if (chunk->ofs < size)
+			break;
+
+		free(chunk->data);
+		node->alloc_size -= chunk->size;
+		node->num_chunks--;
+	}
+
+	if (!node->num_chunks)
+		ramfs_put_chunks(node);
+
+	if (node->recent_chunk >= node->num_chunks)
+		node->recent_chunk = 0;
 }
 
 static struct ramfs_inode* ramfs_get_inode(void)
@@ -166,13 +233,7 @@ static struct ramfs_inode* ramfs_get_inode(void)
 
 static void ramfs_put_inode(struct ramfs_inode *node)
 {
-	struct ramfs_chunk *data = node->data;
-
-	while (data) {
-		struct ramfs_chunk *tmp = data->next;
-		ramfs_put_chunk(data);
-		data = tmp;
-	}
+	ramfs_put_chunks(node);
 
 	free(node->symlink);
 	free(node->name);
@@ -320,79 +381,63 @@ static int ramfs_close(struct device_d *dev, FILE *f)
 	return 0;
 }
 
-static struct ramfs_chunk *ramfs_find_chunk(struct ramfs_inode *node, int chunk)
+static struct ramfs_chunk *ramfs_find_chunk(struct ramfs_inode *node,
+					    unsigned long pos)
 {
-	struct ramfs_chunk *data;
-	int left = chunk;
-
-	if (chunk == 0)
-		return node->data;
+	struct ramfs_chunk *chunk;
+	int lo, hi, mid;
 
-	if (node->recent_chunk == chunk)
-		return node->recent_chunkp;
+	if (pos >= node->alloc_size)
+		return NULL;
 
-	if (node->recent_chunk < chunk && node->recent_chunk != 0) {
-		/* Start at last known chunk */
-		data = node->recent_chunkp;
-		left -= node->recent_chunk;
-	} else {
-		/* Start at first chunk */
-		data = node->data;
+	/* Most accesses are sequential, so try the recent and the next chunk */
+	for (mid = node->recent_chunk;
+	     mid < node->num_chunks && mid <= node->recent_chunk + 1; mid++) {
+		chunk = &node->chunks[mid];
+		if (pos >= chunk->ofs && pos < chunk->ofs + chunk->size)
+			goto found;
 	}
 
-	while (left--)
-		data = data->next;
+	lo = 0;
+	hi = node->num_chunks - 1;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (node->chunks[mid].ofs <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
 
-	node->recent_chunkp = data;
-	node->recent_chunk = chunk;
+	mid = lo;
+	chunk = &node->chunks[mid];
+found:
+	node->recent_chunk = mid;
 
-	return data;
+	return chunk;
 }
 
 static int ramfs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 {
 	struct ramfs_inode *node = f->priv;
-	int chunk;
-	struct ramfs_chunk *data;
-	int ofs;
-	int now;
-	int pos = f->pos;
-	int size = insize;
-
-	chunk = f->pos / CHUNK_SIZE;
-	debug("%s: reading from chunk %d\n", __FUNCTION__, chunk);
-
-	/* Position ourself in stream */
-	data = ramfs_find_chunk(node, chunk);
-	ofs = f->pos % CHUNK_SIZE;
-
-	/* Read till end of current chunk */
-	if (ofs) {
-		now = min(size, CHUNK_SIZE - ofs);
-		debug("Reading till end of node. size: %d\n", size);
-		memcpy(buf, data->data + ofs, now);
+	struct ramfs_chunk *chunk;
+	unsigned long pos = f->pos;
+	unsigned long ofs, now;
+	size_t size = insize;
+
+	while (size) {
+		chunk = ramfs_find_chunk(node, pos);
+		if (!chunk)
+			return -EINVAL;
+
+		ofs = pos - chunk->ofs;
+		now = min_t(unsigned long, size, chunk->size - ofs);
+
+		memcpy(buf, chunk->data + ofs, now);
+
 		size -= now;
 		pos += now;
 		buf += now;
-		if (pos > node->size)
-			node->size = now;
-		data = data->next;
-	}
-
-	/* Do full chunks */
-	while (size >= CHUNK_SIZE) {
-		debug("do full chunk. size: %d\n", size);
-		memcpy(buf, data->data, CHUNK_SIZE);
-		data = data->next;
-		size -= CHUNK_SIZE;
-		pos += CHUNK_SIZE;
-		buf += CHUNK_SIZE;
-	}
-
-	/* And the rest */
-	if (size) {
-		debug("do rest. size: %d\n", size);
-		memcpy(buf, data->data, size);
 	}
 
 	return insize;
@@ -401,47 +446,24 @@ static int ramfs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 static int ramfs_write(struct device_d *_dev, FILE *f, const void *buf, size_t insize)
 {
 	struct ramfs_inode *node = f->priv;
-	int chunk;
-	struct ramfs_chunk *data;
-	int ofs;
-	int now;
-	int pos = f->pos;
-	int size = insize;
-
-	chunk = f->pos / CHUNK_SIZE;
-	debug("%s: writing to chunk %d\n", __FUNCTION__, chunk);
-
-	/* Position ourself in stream */
-	data = ramfs_find_chunk(node, chunk);
-	ofs = f->pos % CHUNK_SIZE;
-
-	/* Write till end of current chunk */
-	if (ofs) {
-		now = min(size, CHUNK_SIZE - ofs);
-		debug("writing till end of node. size: %d\n", size);
-		memcpy(data->data + ofs, buf, now);
+	struct ramfs_chunk *chunk;
+	unsigned long pos = f->pos;
+	unsigned long ofs, now;
+	size_t size = insize;
+
+	while (size) {
+		chunk = ramfs_find_chunk(node, pos);
+		if (!chunk)
+			return -EINVAL;
+
+		ofs = pos - chunk->ofs;
+		now = min_t(unsigned long, size, chunk->size - ofs);
+
+		memcpy(chunk->data + ofs, buf, now);
+
 		size -= now;
 		pos += now;
 		buf += now;
-		if (pos > node->size)
-			node->size = now;
-		data = data->next;
-	}
-
-	/* Do full chunks */
-	while (size >= CHUNK_SIZE) {
-		debug("do full chunk. size: %d\n", size);
-		memcpy(data->data, buf, CHUNK_SIZE);
-		data = data->next;
-		size -= CHUNK_SIZE;
-		pos += CHUNK_SIZE;
-		buf += CHUNK_SIZE;
-	}
-
-	/* And the rest */
-	if (size) {
-		debug("do rest. size: %d\n", size);
-		memcpy(data->data, buf, size);
 	}
 
 	return insize;
@@ -456,49 +478,34 @@ static loff_t ramfs_lseek(struct device_d *dev, FILE *f, loff_t pos)
 static int ramfs_truncate(struct device_d *dev, FILE *f, ulong size)
 {
 	struct ramfs_inode *node = f->priv;
-	int oldchunks, newchunks;
-	struct ramfs_chunk *data = node->data;
-
-	newchunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-	oldchunks = (node->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-
-	if (newchunks < oldchunks) {
-		if (!newchunks)
-			node->data = NULL;
-		while (newchunks--)
-			data = data->next;
-		while (data) {
-			struct ramfs_chunk *tmp;
-			tmp = data->next;
-			ramfs_put_chunk(data);
-			data = tmp;
-		}
-		if (node->recent_chunk > newchunks)
-			node->recent_chunk = 0;
+	int ret;
+
+	if (size > node->alloc_size) {
+		ret = ramfs_grow(node, size);
+		if (ret)
+			return ret;
+	} else {
+		ramfs_shrink(node, size);
 	}
 
-	if (newchunks > oldchunks) {
-		if (!data) {
-			node->data = ramfs_get_chunk();
-			if (!node->data)
-				return -ENOMEM;
-			data = node->data;
-		}
+	node->size = size;
 
-		newchunks--;
-		while (data->next) {
-			newchunks--;
-			data = data->next;
-		}
+	return 0;
+}
+
+/*
+ * A file can only be mapped when its data is contiguous in memory, that is
+ * when it consists of a single chunk. Callers fall back to read() otherwise.
+ */
+static int ramfs_memmap(struct device_d *_dev, FILE *f, void **map, int flags)
+{
+	struct ramfs_inode *node = f->priv;
+
+	if (node->num_chunks != 1)
+		return -EINVAL;
+
+	*map = node->chunks[0].data;
 
-		while (newchunks--) {
-			data->next = ramfs_get_chunk();
-			if (!data->next)
-				return -ENOMEM;
-			data = data->next;
-		}
-	}
-	node->size = size;
 	return 0;
 }
 
@@ -622,6 +629,7 @@ static struct fs_driver_d ramfs_driver = {
 	.read      = ramfs_read,
 	.write     = ramfs_write,
 	.lseek     = ramfs_lseek,
+	.memmap    = ramfs_memmap,
 	.mkdir     = ramfs_mkdir,
 	.rmdir     = ramfs_rmdir,
 	.opendir   = ramfs_opendir,
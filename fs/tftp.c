@@ -31,7 +31,10 @@
 #include <linux/stat.h>
 #include <linux/err.h>
 #include <kfifo.h>
+#include <globalvar.h>
+#include <magicvar.h>
 #include <linux/sizes.h>
+#include <linux/log2.h>
 
 #define TFTP_PORT	69	/* Well known TFTP port number */
 
@@ -66,8 +69,29 @@
 #define TFTP_BLOCK_SIZE		512	/* default TFTP block size */
 #define TFTP_FIFO_SIZE		4096
 
+/*
+ * Largest block size which fits into a single ethernet frame: 1500 bytes
+ * MTU minus IP header, UDP header and TFTP header.
+ */
+#define TFTP_MTU_BLOCK_SIZE	(1500 - sizeof(struct iphdr) - \
+				 sizeof(struct udphdr) - 4)
+
+#define TFTP_MAX_BLOCK_SIZE	65464	/* RFC 2348 */
+#define TFTP_MAX_WINDOW_SIZE	64
+
 #define TFTP_ERR_RESEND	1
 
+/*
+ * A received data block. It stays in the packet buffer it was received in
+ * unless the driver does not use packet buffers, then it is copied.
+ */
+struct tftp_block {
+	struct list_head list;
+	struct pktbuf *pb;
+	void *data;
+	int len;
+};
+
 struct file_priv {
 	struct net_connection *tftp_con;
 	int push;
@@ -79,12 +103,23 @@ struct file_priv {
 	int filesize;
 	uint64_t resend_timeout;
 	uint64_t progress_timeout;
-	struct kfifo *fifo;
+	struct kfifo *fifo;		/* data to be written */
+	struct list_head blocks;	/* data received, not yet read */
+	unsigned int queued;		/* bytes in blocks */
+	unsigned int fifo_size;
 	void *buf;
 	int blocksize;
+	int windowsize;
+	int window_pos;	/* blocks received since the last ACK */
+	int out_of_order;
+	int req_blocksize;
+	int req_windowsize;
 	int block_requested;
 };
 
+static int tftp_blocksize = TFTP_MTU_BLOCK_SIZE;
+static int tftp_windowsize = 8;
+
 struct tftp_priv {
 	IPaddr_t server;
 };
@@ -142,15 +177,25 @@ static int tftp_send(struct file_priv *priv)
 				"tsize%c"
 				"%d%c"
 				"blksize%c"
-				"1432",
+				"%d",
 				priv->filename, 0,
 				0,
 				0,
 				TIMEOUT, 0,
 				0,
 				priv->filesize, 0,
-				0);
+				0,
+				priv->req_blocksize);
 		pkt++;
+		/* windowed transfers (RFC 7440) are only supported for reading */
+		if (priv->state == STATE_RRQ && priv->req_windowsize > 1) {
+			pkt += sprintf((unsigned char *)pkt,
+					"windowsize%c"
+					"%d",
+					0,
+					priv->req_windowsize);
+			pkt++;
+		}
 		len = pkt - xp;
 		break;
 
@@ -163,6 +208,7 @@ static int tftp_send(struct file_priv *priv)
 		*s++ = htons(TFTP_ACK);
 		*s++ = htons(priv->block);
 		priv->block_requested = priv->block;
+		priv->window_pos = 0;
 		pkt = (unsigned char *)s;
 		len = pkt - xp;
 		break;
@@ -242,6 +288,8 @@ static void tftp_parse_oack(struct file_priv *priv, unsigned char *pkt, int len)
 			priv->filesize = simple_strtoul(val, NULL, 10);
 		if (!strcmp(opt, "blksize"))
 			priv->blocksize = simple_strtoul(val, NULL, 10);
+		if (!strcmp(opt, "windowsize"))
+			priv->windowsize = simple_strtoul(val, NULL, 10);
 		debug("OACK opt: %s val: %s\n", opt, val);
 		s = val + strlen(val) + 1;
 	}
@@ -252,6 +300,71 @@ static void tftp_timer_reset(struct file_priv *priv)
 	priv->progress_timeout = priv->resend_timeout = get_time_ns();
 }
 
+static void tftp_queue_block(struct file_priv *priv, void *data, int len)
+{
+	struct tftp_block *b;
+	struct pktbuf *pb;
+
+	if (!len)
+		return;
+
+	pb = net_rx_hold();
+	if (pb) {
+		b = xmalloc(sizeof(*b));
+		b->data = data;
+	} else {
+		b = xmalloc(sizeof(*b) + len);
+		b->data = memcpy(b + 1, data, len);
+	}
+
+	b->pb = pb;
+	b->len = len;
+	list_add_tail(&b->list, &priv->blocks);
+	priv->queued += len;
+}
+
+static void tftp_free_block(struct tftp_block *b)
+{
+	list_del(&b->list);
+	if (b->pb)
+		pktbuf_put(b->pb);
+	free(b);
+}
+
+static void tftp_free_blocks(struct file_priv *priv)
+{
+	struct tftp_block *b, *tmp;
+
+	list_for_each_entry_safe(b, tmp, &priv->blocks, list)
+		tftp_free_block(b);
+
+	priv->queued = 0;
+}
+
+static size_t tftp_get_blocks(struct file_priv *priv, void *buf, size_t size)
+{
+	struct tftp_block *b, *tmp;
+	size_t now, done = 0;
+
+	list_for_each_entry_safe(b, tmp, &priv->blocks, list) {
+		if (done == size)
+			break;
+
+		now = min_t(size_t, b->len, size - done);
+		memcpy(buf + done, b->data, now);
+		done += now;
+		b->data += now;
+		b->len -= now;
+
+		if (!b->len)
+			tftp_free_block(b);
+	}
+
+	priv->queued -= done;
+
+	return done;
+}
+
 static void tftp_recv(struct file_priv *priv,
 			uint8_t *pkt, unsigned len, uint16_t uh_sport)
 {
@@ -331,15 +444,31 @@ static void tftp_recv(struct file_priv *priv,
 			}
 		}
 
-		if (priv->block == priv->last_block)
-			/* Same block again; ignore it. */
+		if (priv->block != (uint16_t)(priv->last_block + 1)) {
+			/*
+			 * Same block again or a block of the current window
+			 * got lost. Ignore it and acknowledge the last block
+			 * received in order once so that the server continues
+			 * from there.
+			 */
+			debug("unexpected block %d, last %d\n", priv->block,
+					priv->last_block);
+			priv->block = priv->last_block;
+			if (priv->windowsize > 1 && !priv->out_of_order) {
+				priv->out_of_order = 1;
+				priv->block_requested = -1;
+				priv->window_pos = priv->windowsize;
+			}
 			break;
+		}
 
 		priv->last_block = priv->block;
+		priv->out_of_order = 0;
+		priv->window_pos++;
 
 		tftp_timer_reset(priv);
 
-		kfifo_put(priv->fifo, pkt + 2, len);
+		tftp_queue_block(priv, pkt + 2, len);
 
 		if (len < priv->blocksize) {
 			tftp_send(priv);
@@ -415,12 +544,29 @@ static struct file_priv *tftp_do_open(struct device_d *dev,
 	priv->err = -EINVAL;
 	priv->filename = filename;
 	priv->blocksize = TFTP_BLOCK_SIZE;
+	priv->windowsize = 1;
 	priv->block_requested = -1;
-
-	priv->fifo = kfifo_alloc(TFTP_FIFO_SIZE);
-	if (!priv->fifo) {
-		ret = -ENOMEM;
-		goto out;
+	priv->req_blocksize = clamp(tftp_blocksize, 8, TFTP_MAX_BLOCK_SIZE);
+	priv->req_windowsize = priv->push ? 1 :
+		clamp(tftp_windowsize, 1, TFTP_MAX_WINDOW_SIZE);
+
+	INIT_LIST_HEAD(&priv->blocks);
+
+	/*
+	 * We must be able to buffer a whole window of the largest block
+	 * size we may negotiate. The server may agree to smaller values in
+	 * the OACK.
+	 */
+	priv->fifo_size = max_t(unsigned int, TFTP_FIFO_SIZE,
+			roundup_pow_of_two(2 * priv->req_windowsize *
+					   priv->req_blocksize));
+
+	if (priv->push) {
+		priv->fifo = kfifo_alloc(priv->fifo_size);
+		if (!priv->fifo) {
+			ret = -ENOMEM;
+			goto out;
+		}
 	}
 
 	priv->tftp_con = net_udp_new(tpriv->server, TFTP_PORT, tftp_handler,
@@ -450,13 +596,23 @@ static struct file_priv *tftp_do_open(struct device_d *dev,
 		goto out2;
 	}
 
+	if (priv->blocksize > priv->req_blocksize ||
+	    priv->windowsize < 1 || priv->windowsize > priv->req_windowsize) {
+		pr_err("tftp: server negotiated invalid blksize %d / windowsize %d\n",
+				priv->blocksize, priv->windowsize);
+		ret = -EINVAL;
+		goto out2;
+	}
+
 	priv->buf = xmalloc(priv->blocksize);
 
 	return priv;
 out2:
 	net_unregister(priv->tftp_con);
 out1:
-	kfifo_free(priv->fifo);
+	tftp_free_blocks(priv);
+	if (priv->fifo)
+		kfifo_free(priv->fifo);
 out:
 	free(priv);
 
@@ -508,7 +664,9 @@ static int tftp_do_close(struct file_priv *priv)
 	}
 
 	net_unregister(priv->tftp_con);
-	kfifo_free(priv->fifo);
+	tftp_free_blocks(priv);
+	if (priv->fifo)
+		kfifo_free(priv->fifo);
 	free(priv->buf);
 	free(priv);
 
@@ -567,14 +725,20 @@ static int tftp_read(struct device_d *dev, FILE *f, void *buf, size_t insize)
 	debug("%s %zu\n", __func__, insize);
 
 	while (insize) {
-		now = kfifo_get(priv->fifo, buf, insize);
+		now = tftp_get_blocks(priv, buf, insize);
 		outsize += now;
 		buf += now;
 		insize -= now;
 		if (priv->state == STATE_DONE)
 			return outsize;
 
-		if (TFTP_FIFO_SIZE - kfifo_len(priv->fifo) >= priv->blocksize)
+		/*
+		 * Acknowledge the current window once it is complete and we
+		 * have room for the next one.
+		 */
+		if (priv->window_pos >= priv->windowsize &&
+		    priv->queued + priv->windowsize * priv->blocksize <=
+		    priv->fifo_size)
 			tftp_send(priv);
 
 		ret = tftp_poll(priv);
@@ -685,6 +849,14 @@ static struct fs_driver_d tftp_driver = {
 
 static int tftp_init(void)
 {
+	globalvar_add_simple_int("tftp.blocksize", &tftp_blocksize, "%d");
+	globalvar_add_simple_int("tftp.windowsize", &tftp_windowsize, "%d");
+
 	return register_fs_driver(&tftp_driver);
 }
 coredevice_initcall(tftp_init);
+
+BAREBOX_MAGICVAR_NAMED(global_tftp_blocksize, global.tftp.blocksize,
+		"TFTP block size to request (RFC 2348)");
+BAREBOX_MAGICVAR_NAMED(global_tftp_windowsize, global.tftp.windowsize,
+		"Number of TFTP blocks to request per ACK when reading (RFC 7440)");
@@ -128,6 +128,24 @@ static loff_t uimagefs_lseek(struct device_d *dev, FILE *file, loff_t pos)
 	return pos;
 }
 
+static int uimagefs_memmap(struct device_d *dev, FILE *file, void **map,
+			   int flags)
+{
+	struct uimagefs_handle_data *d = file->priv;
+	void *base;
+
+	if (!uimagefs_is_data_file(d) || (flags & PROT_WRITE))
+		return -EINVAL;
+
+	base = memmap(d->fd, flags);
+	if (base == (void *)-1)
+		return -errno;
+
+	*map = base + d->offset;
+
+	return 0;
+}
+
 static DIR *uimagefs_opendir(struct device_d *dev, const char *pathname)
 {
 	struct uimagefs_handle *priv = dev->priv;
@@ -524,6 +542,7 @@ static struct fs_driver_d uimagefs_driver = {
 	.close     = uimagefs_close,
 	.read      = uimagefs_read,
 	.lseek     = uimagefs_lseek,
+	.memmap    = uimagefs_memmap,
 	.opendir   = uimagefs_opendir,
 	.readdir   = uimagefs_readdir,
 	.closedir  = uimagefs_closedir,
@@ -9,12 +9,18 @@
 struct bbu_data {
 #define BBU_FLAG_FORCE	(1 << 0)
 #define BBU_FLAG_YES	(1 << 1)
+/*
+ * Only the first len bytes of the image are in memory, the handler has
+ * to read the remaining data from imagefile itself.
+ */
+#define BBU_FLAG_STREAM	(1 << 2)
 	unsigned long flags;
 	int force;
 	const void *image;
 	const char *imagefile;
 	const char *devicefile;
 	size_t len;
+	loff_t image_size;
 	const char *handler_name;
 	const struct imd_header *imd_data;
 };
@@ -25,6 +31,8 @@ struct bbu_handler {
 	struct list_head list;
 #define BBU_HANDLER_FLAG_DEFAULT	(1 << 0)
 #define BBU_HANDLER_CAN_REFRESH		(1 << 1)
+/* handler can deal with BBU_FLAG_STREAM */
+#define BBU_HANDLER_CAN_STREAM		(1 << 2)
 	unsigned long flags;
 
 	/* default device file, can be overwritten on the command line */
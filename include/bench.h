@@ -0,0 +1,14 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <linux/types.h>
+
+struct bench_result {
+	u64 ms;		/* elapsed time in milliseconds */
+	u64 kbps;	/* throughput in KiB/s */
+};
+
+void bench_fill_random(void *buf, size_t size);
+void bench_stop(u64 start, u64 bytes, struct bench_result *res);
+
+#endif /* __BENCH_H */
@@ -3,6 +3,7 @@
 
 #include <driver.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 
 struct block_device;
 
@@ -23,8 +24,17 @@ struct block_device {
 	int rdbufsize;
 	int blkmask;
 
+	int cache_chunks;	/* number of chunks in the cache */
+	int cache_chunksize;	/* size of a chunk in bytes */
+	int readahead;		/* chunks to read ahead on sequential access */
+	int ra_next;		/* first block after the last cache fill */
+	int ra_chunks;		/* chunks read at once during readahead */
+	void *ra_buf;		/* contiguous data of the first ra_chunks chunks */
+	struct chunk *chunks;
+
 	struct list_head buffered_blocks;
 	struct list_head idle_blocks;
+	struct rb_root chunk_tree;
 
 	struct cdev cdev;
 };
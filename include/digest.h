@@ -162,6 +162,11 @@ static inline const char *digest_name(struct digest *d)
 	return d->algo->base.name;
 }
 
+static inline const char *digest_driver_name(struct digest *d)
+{
+	return d->algo->base.driver_name;
+}
+
 static inline void* digest_ctx(struct digest *d)
 {
 	return d->ctx;
@@ -10,12 +10,22 @@
 
 #include <malloc.h>
 #include <xfuncs.h>
+#include <linux/kernel.h>
 
 #include <dma-dir.h>
 #include <asm/dma.h>
 
 #define DMA_ADDRESS_BROKEN	NULL
 
+#ifndef DMA_ALIGNMENT
+#define DMA_ALIGNMENT	32
+#endif
+
+static inline int dma_buf_is_aligned(const void *buf)
+{
+	return IS_ALIGNED((unsigned long)buf, DMA_ALIGNMENT);
+}
+
 #ifndef dma_alloc
 static inline void *dma_alloc(size_t size)
 {
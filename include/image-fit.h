@@ -19,6 +19,7 @@
 #define __IMAGE_FIT_H__
 
 #include <linux/types.h>
+#include <linux/list.h>
 #include <bootm.h>
 
 struct fit_handle {
@@ -26,6 +27,13 @@ struct fit_handle {
 	void *fit_alloc;
 	size_t size;
 
+	/*
+	 * When opened in streaming mode the image "data" properties are
+	 * not part of @fit, they are read from @fd on demand instead.
+	 */
+	int fd;
+	struct list_head data;
+
 	bool verbose;
 	enum bootm_verify verify;
 
@@ -44,6 +52,12 @@ int fit_has_image(struct fit_handle *handle, void *configuration,
 int fit_open_image(struct fit_handle *handle, void *configuration,
 		   const char *name, const void **outdata,
 		   unsigned long *outsize);
+int fit_get_image_size(struct fit_handle *handle, void *configuration,
+		       const char *name, unsigned long *outsize);
+int fit_load_image(struct fit_handle *handle, void *configuration,
+		   const char *name, void *dest, unsigned long size);
+int fit_verify_image(struct fit_handle *handle, void *configuration,
+		     const char *name);
 
 void fit_close(struct fit_handle *handle);
 
@@ -13,8 +13,13 @@ int read_file_2(const char *filename, size_t *size, void **outbuf,
 
 int write_file(const char *filename, const void *buf, size_t size);
 
+struct digest;
+
 int copy_file(const char *src, const char *dst, int verbose);
 
+int copy_file_digest(const char *src, const char *dst, int verbose,
+		     struct digest *d);
+
 int copy_recursive(const char *src, const char *dst);
 
 int compare_file(const char *f1, const char *f2);
@@ -40,6 +40,8 @@ struct eth_device {
 	int  (*open) (struct eth_device*);
 	int  (*send) (struct eth_device*, void *packet, int length);
 	int  (*recv) (struct eth_device*);
+	/* receive up to budget frames, return the number received */
+	int  (*poll) (struct eth_device*, int budget);
 	void (*halt) (struct eth_device*);
 	int  (*get_ethaddr) (struct eth_device*, u8 adr[6]);
 	int  (*set_ethaddr) (struct eth_device*, const unsigned char *adr);
@@ -70,6 +72,13 @@ struct eth_device {
 #define ETH_MODE_STATIC 1
 #define ETH_MODE_DISABLED 2
 	unsigned int global_mode;
+
+	/* receive statistics, shown as device parameters */
+	uint32_t rx_packets;
+	uint32_t rx_polls;	/* polls which received at least one frame */
+	uint32_t rx_max_burst;	/* most frames received in a single poll */
+	uint32_t rx_dropped;	/* frames the driver had to discard */
+	uint32_t rx_ring_full;	/* times the driver ran out of descriptors */
 };
 
 #define dev_to_edev(d) container_of(d, struct eth_device, dev)
@@ -85,6 +94,7 @@ int eth_set_ethaddr(struct eth_device *edev, const char *ethaddr);
 
 int eth_send(struct eth_device *edev, void *packet, int length);	   /* Send a packet		*/
 int eth_rx(void);			/* Check for received packets	*/
+int eth_poll(struct eth_device *edev, int budget);
 
 /* associate a MAC address to a ethernet device. Should be called by
  * board code for boards which store their MAC address at some unusual
@@ -433,6 +443,60 @@ struct eth_device *eth_get_byname(const char *name);
  */
 int net_receive(struct eth_device *edev, unsigned char *pkt, int len);
 
+/*
+ * Packet buffers
+ *
+ * Drivers which can receive into arbitrary memory take their receive buffers
+ * from a pool of reference counted packet buffers and pass them up with
+ * net_receive_pktbuf(). A protocol which needs the data of a packet after its
+ * handler returned takes a reference with net_rx_hold() instead of copying
+ * it, the driver then continues with a fresh buffer from the pool.
+ */
+#define PKTBUF_SIZE		1600	/* largest frame plus FCS and status words */
+#define PKTBUF_HEADROOM		64	/* in front of data, for drivers to use */
+#define PKTBUF_POOL_MAX		256
+
+struct pktbuf {
+	struct list_head list;	/* free list */
+	unsigned char *data;
+	unsigned int len;
+	unsigned int size;	/* of the data area */
+	int refcount;
+	int pooled;		/* returned to the pool when freed */
+};
+
+struct pktbuf *pktbuf_alloc(void);
+struct pktbuf *pktbuf_alloc_size(unsigned int size);
+void pktbuf_put(struct pktbuf *pb);
+struct pktbuf *pktbuf_from_data(void *data);
+
+static inline struct pktbuf *pktbuf_get(struct pktbuf *pb)
+{
+	pb->refcount++;
+	return pb;
+}
+
+/**
+ * net_receive_pktbuf - Pass a received packet buffer to the protocol stack
+ * @pb: The buffer the packet was received into
+ * @len: length of the packet
+ *
+ * Return the buffer to receive the next packet into. This is @pb again
+ * unless a protocol kept it, in which case the driver's reference has been
+ * dropped and a new buffer is returned.
+ */
+struct pktbuf *net_receive_pktbuf(struct eth_device *edev, struct pktbuf *pb,
+		int len);
+
+/**
+ * net_rx_hold - Keep the buffer of the packet currently being handled
+ *
+ * Returns the buffer with an additional reference which has to be dropped
+ * with pktbuf_put() or NULL if the packet has to be copied because it was
+ * not received into a packet buffer or the pool is exhausted.
+ */
+struct pktbuf *net_rx_hold(void);
+
 struct net_connection {
 	struct ethernet *et;
 	struct iphdr *ip;
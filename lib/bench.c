@@ -0,0 +1,49 @@
+/*
+ * bench.c - helpers for the benchmark commands
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <common.h>
+#include <bench.h>
+#include <clock.h>
+#include <stdlib.h>
+#include <linux/math64.h>
+
+/* Fill a buffer with random data, @size may exceed what an int can hold */
+void bench_fill_random(void *buf, size_t size)
+{
+	while (size) {
+		int now = min_t(size_t, size, INT_MAX);
+
+		get_random_bytes(buf, now);
+		buf += now;
+		size -= now;
+	}
+}
+
+/**
+ * bench_stop - finish a measurement
+ * @start: get_time_ns() when the measurement started
+ * @bytes: number of bytes processed since @start
+ * @res: returns the elapsed time and the throughput
+ */
+void bench_stop(u64 start, u64 bytes, struct bench_result *res)
+{
+	u64 us = div_u64(get_time_ns() - start, 1000);
+
+	if (!us)
+		us = 1;
+
+	res->ms = div_u64(us, 1000);
+	/* bytes * 1000000 / 1024 / us */
+	res->kbps = div64_u64(bytes * 15625, us * 16);
+}
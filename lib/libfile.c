@@ -22,6 +22,8 @@
 #include <progress.h>
 #include <stdlib.h>
 #include <linux/stat.h>
+#include <linux/sizes.h>
+#include <digest.h>
 
 /*
  * write_full - write to filedescriptor
@@ -250,27 +252,56 @@ int write_file(const char *filename, const void *buf, size_t size)
 }
 EXPORT_SYMBOL(write_file);
 
+/*
+ * Buffer size used by copy_file(). Devices like USB mass storage or MMC
+ * have a high per command overhead, so transfer big chunks at once.
+ */
+#define COPY_BUF_SIZE	SZ_1M
+
+static void *copy_file_alloc_buf(size_t *size)
+{
+	size_t len;
+	void *buf;
+
+	for (len = COPY_BUF_SIZE; len > RW_BUF_SIZE; len /= 2) {
+		buf = malloc(len);
+		if (buf) {
+			*size = len;
+			return buf;
+		}
+	}
+
+	*size = RW_BUF_SIZE;
+
+	return xmalloc(RW_BUF_SIZE);
+}
+
 /**
- * copy_file - Copy a file
+ * copy_file_digest - Copy a file and calculate a digest over the data
  * @src:	The source filename
  * @dst:	The destination filename
  * @verbose:	if true, show a progression bar
+ * @d:		if not NULL, this digest is initialized and updated with the
+ *		data written to @dst. Use digest_final() to get the result.
+ *
+ * When @src can be memory mapped the data is written directly from the
+ * mapping, otherwise it is copied in big chunks through a buffer.
  *
  * Return: 0 for success or negative error code
  */
-int copy_file(const char *src, const char *dst, int verbose)
+int copy_file_digest(const char *src, const char *dst, int verbose,
+		     struct digest *d)
 {
-	char *rw_buf = NULL;
+	char *rw_buf = NULL, *map = (void *)-1;
+	size_t bufsize;
 	int srcfd = 0, dstfd = 0;
 	int r, w;
 	int ret = 1, err1 = 0;
 	int mode;
 	void *buf;
-	int total = 0;
+	loff_t total = 0;
 	struct stat srcstat, dststat;
 
-	rw_buf = xmalloc(RW_BUF_SIZE);
-
 	srcfd = open(src, O_RDONLY);
 	if (srcfd < 0) {
 		printf("could not open %s: %s\n", src, errno_str());
@@ -293,34 +324,58 @@ int copy_file(const char *src, const char *dst, int verbose)
 		goto out;
 	}
 
-	if (verbose) {
-		if (stat(src, &srcstat) < 0)
-			srcstat.st_size = 0;
+	if (fstat(srcfd, &srcstat) < 0)
+		srcstat.st_size = 0;
 
-		init_progression_bar(srcstat.st_size);
+	if (srcstat.st_size && srcstat.st_size != FILESIZE_MAX)
+		map = memmap(srcfd, PROT_READ);
+
+	if (map == (void *)-1)
+		rw_buf = copy_file_alloc_buf(&bufsize);
+	else
+		bufsize = COPY_BUF_SIZE;
+
+	if (d) {
+		ret = digest_init(d);
+		if (ret)
+			goto out;
 	}
 
+	if (verbose)
+		init_progression_bar(srcstat.st_size);
+
 	while (1) {
-		r = read(srcfd, rw_buf, RW_BUF_SIZE);
-		if (r < 0) {
-			perror("read");
-			goto out;
+		if (rw_buf) {
+			r = read_full(srcfd, rw_buf, bufsize);
+			if (r < 0) {
+				perror("read");
+				ret = r;
+				goto out;
+			}
+			buf = rw_buf;
+		} else {
+			r = min_t(loff_t, bufsize, srcstat.st_size - total);
+			buf = map + total;
 		}
+
 		if (!r)
 			break;
 
-		buf = rw_buf;
-		while (r) {
-			w = write(dstfd, buf, r);
-			if (w < 0) {
-				perror("write");
+		if (d) {
+			ret = digest_update(d, buf, r);
+			if (ret)
 				goto out;
-			}
-			buf += w;
-			r -= w;
-			total += w;
 		}
 
+		w = write_full(dstfd, buf, r);
+		if (w < 0) {
+			perror("write");
+			ret = w;
+			goto out;
+		}
+
+		total += r;
+
 		if (verbose) {
 			if (srcstat.st_size && srcstat.st_size != FILESIZE_MAX)
 				show_progress(total);
@@ -342,6 +397,20 @@ out:
 
 	return ret ?: err1;
 }
+EXPORT_SYMBOL(copy_file_digest);
+
+/**
+ * copy_file - Copy a file
+ * @src:	The source filename
+ * @dst:	The destination filename
+ * @verbose:	if true, show a progression bar
+ *
+ * Return: 0 for success or negative error code
+ */
+int copy_file(const char *src, const char *dst, int verbose)
+{
+	return copy_file_digest(src, dst, verbose, NULL);
+}
 EXPORT_SYMBOL(copy_file);
 
 int copy_recursive(const char *src, const char *dst)
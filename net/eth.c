@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <malloc.h>
 #include <globalvar.h>
+#include <magicvar.h>
 #include <environment.h>
 #include <linux/ctype.h>
 #include <linux/stat.h>
@@ -248,6 +249,42 @@ int eth_send(struct eth_device *edev, void *packet, int length)
 	return edev->send(edev, packet, length);
 }
 
+/* upper limit for global.net.rx_budget */
+#define ETH_RX_BUDGET_MAX	256
+
+static int eth_rx_budget = 16;
+
+/**
+ * eth_poll - receive pending frames of a device
+ * @edev: The device
+ * @budget: maximum number of frames to receive, also limited by
+ *          global.net.rx_budget
+ *
+ * Drivers with a poll callback pass a burst of frames to the stack in one
+ * call, others receive a single frame. Returns the number of frames received,
+ * which is not known and reported as 0 for drivers without poll callback.
+ */
+int eth_poll(struct eth_device *edev, int budget)
+{
+	int ret;
+
+	if (!edev->poll) {
+		edev->recv(edev);
+		return 0;
+	}
+
+	budget = min(budget, clamp(eth_rx_budget, 1, ETH_RX_BUDGET_MAX));
+
+	ret = edev->poll(edev, budget);
+	if (ret > 0) {
+		edev->rx_packets += ret;
+		edev->rx_polls++;
+		edev->rx_max_burst = max_t(uint32_t, edev->rx_max_burst, ret);
+	}
+
+	return ret;
+}
+
 static int __eth_rx(struct eth_device *edev)
 {
 	int ret;
@@ -260,7 +297,7 @@ static int __eth_rx(struct eth_device *edev)
 	if (ret)
 		return ret;
 
-	return edev->recv(edev);
+	return eth_poll(edev, ETH_RX_BUDGET_MAX);
 }
 
 int eth_rx(void)
@@ -408,6 +445,11 @@ int eth_register(struct eth_device *edev)
 	dev_add_param_enum(dev, "mode", NULL, NULL, &edev->global_mode,
 				  eth_mode_names, ARRAY_SIZE(eth_mode_names),
 				  NULL);
+	dev_add_param_uint32_ro(dev, "rx_packets", &edev->rx_packets, "%u");
+	dev_add_param_uint32_ro(dev, "rx_polls", &edev->rx_polls, "%u");
+	dev_add_param_uint32_ro(dev, "rx_max_burst", &edev->rx_max_burst, "%u");
+	dev_add_param_uint32_ro(dev, "rx_dropped", &edev->rx_dropped, "%u");
+	dev_add_param_uint32_ro(dev, "rx_ring_full", &edev->rx_ring_full, "%u");
 
 	if (edev->init)
 		edev->init(edev);
@@ -458,3 +500,14 @@ void led_trigger_network(enum led_trigger trigger)
 	led_trigger(trigger, TRIGGER_FLASH);
 	led_trigger(LED_TRIGGER_NET_TXRX, TRIGGER_FLASH);
 }
+
+static int eth_init(void)
+{
+	globalvar_add_simple_int("net.rx_budget", &eth_rx_budget, "%d");
+
+	return 0;
+}
+postcore_initcall(eth_init);
+
+BAREBOX_MAGICVAR_NAMED(global_net_rx_budget, global.net.rx_budget,
+		"Maximum number of frames received from a device in one poll");
@@ -38,11 +38,16 @@
 #include <init.h>
 #include <globalvar.h>
 #include <magicvar.h>
+#include <linux/bitmap.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <pico_stack.h>
+#include <picotcp.h>
 
 unsigned char *NetRxPackets[PKTBUFSRX]; /* Receive packets		*/
+static struct pktbuf *net_rx_pb;	/* buffer of the packet being handled */
+static struct pktbuf *net_rx_driver_pb;	/* the driver's receive buffer */
+static struct pktbuf *net_rx_spare;	/* its replacement if it is kept */
 static unsigned int net_ip_id;
 
 IPaddr_t net_serverip;
@@ -251,9 +256,14 @@ static int arp_request(struct eth_device *edev, IPaddr_t dest, unsigned char *et
 	return 0;
 }
 
+static void ip_frag_expire(void);
+
 void net_poll(void)
 {
 	eth_rx();
+
+	if (IS_ENABLED(CONFIG_NET_IP_REASSEMBLY))
+		ip_frag_expire();
 }
 
 static uint16_t net_udp_new_localport(void)
@@ -570,6 +580,212 @@ static int net_handle_icmp(unsigned char *pkt, int len)
 	return 0;
 }
 
+#define IP_FLAG_MF	0x2000		/* more fragments follow */
+#define IP_OFFSET	0x1fff		/* fragment offset in 8 byte units */
+
+/* largest payload an IP datagram can carry */
+#define IP_MAX_PAYLOAD	(0xffff - sizeof(struct iphdr))
+
+#define IP_FRAG_SLOTS	4
+#define IP_FRAG_TIMEOUT	(2 * SECOND)
+
+/*
+ * A datagram under reassembly. The buffer is laid out like a received
+ * packet: ethernet header, IP header without options, then the payload, so
+ * that the completed datagram can be passed to the protocol handlers as is.
+ * Which 8 byte units of the payload have arrived is tracked in a bitmap,
+ * duplicated or overlapping fragments are harmless this way.
+ */
+struct ip_frag {
+	struct pktbuf *pb;
+	int used;
+	uint64_t start;
+	IPaddr_t saddr;
+	IPaddr_t daddr;
+	uint16_t id;
+	uint8_t protocol;
+	unsigned int total;	/* payload size, 0 until the last fragment arrived */
+	unsigned int units;	/* 8 byte units received */
+	DECLARE_BITMAP(map, DIV_ROUND_UP(IP_MAX_PAYLOAD, 8));
+};
+
+static struct ip_frag ip_frags[IP_FRAG_SLOTS];
+
+static void ip_frag_expire(void)
+{
+	int i;
+
+	for (i = 0; i < IP_FRAG_SLOTS; i++) {
+		struct ip_frag *f = &ip_frags[i];
+
+		if (f->used && is_timeout(f->start, IP_FRAG_TIMEOUT)) {
+			pr_debug("%s: id 0x%04x timed out\n", __func__,
+				 ntohs(f->id));
+			f->used = 0;
+		}
+	}
+}
+
+static struct ip_frag *ip_frag_find(struct iphdr *ip)
+{
+	struct ip_frag *f, *slot = NULL, *oldest = NULL;
+	IPaddr_t saddr = net_read_ip(&ip->saddr);
+	IPaddr_t daddr = net_read_ip(&ip->daddr);
+	int i;
+
+	for (i = 0; i < IP_FRAG_SLOTS; i++) {
+		f = &ip_frags[i];
+
+		if (!f->used) {
+			if (!slot)
+				slot = f;
+			continue;
+		}
+
+		if (f->id == ip->id && f->protocol == ip->protocol &&
+		    f->saddr == saddr && f->daddr == daddr)
+			return f;
+
+		if (!oldest || f->start < oldest->start)
+			oldest = f;
+	}
+
+	/* all slots busy, give up on the oldest datagram */
+	if (!slot) {
+		pr_debug("%s: dropping id 0x%04x\n", __func__,
+			 ntohs(oldest->id));
+		slot = oldest;
+	}
+
+	f = slot;
+
+	if (!f->pb) {
+		f->pb = pktbuf_alloc_size(ETHER_HDR_SIZE +
+					  sizeof(struct iphdr) +
+					  IP_MAX_PAYLOAD);
+		if (!f->pb)
+			return NULL;
+	}
+
+	f->used = 1;
+	f->start = get_time_ns();
+	f->saddr = saddr;
+	f->daddr = daddr;
+	f->id = ip->id;
+	f->protocol = ip->protocol;
+	f->total = 0;
+	f->units = 0;
+	bitmap_zero(f->map, DIV_ROUND_UP(IP_MAX_PAYLOAD, 8));
+
+	return f;
+}
+
+static int net_handle_ip_payload(unsigned char *pkt, int len)
+{
+	struct iphdr *ip = (struct iphdr *)(pkt + ETHER_HDR_SIZE);
+
+	switch (ip->protocol) {
+	case IPPROTO_ICMP:
+		return net_handle_icmp(pkt, len);
+	case IPPROTO_UDP:
+		return net_handle_udp(pkt, len);
+	}
+
+	return 0;
+}
+
+/*
+ * Pass a reassembled datagram to the protocols. The slot buffer is sized
+ * for the largest possible datagram, so the datagram is copied to a buffer
+ * of its own size first. The protocols can keep that one like a driver
+ * buffer while the slot keeps its buffer for the next datagram.
+ */
+static int ip_frag_deliver(struct ip_frag *f, int len)
+{
+	struct pktbuf *rx_pb = net_rx_pb;
+	struct pktbuf *pb;
+	int ret;
+
+	pb = pktbuf_alloc_size(len);
+	if (!pb)
+		return 0;
+
+	memcpy(pb->data, f->pb->data, len);
+	pb->len = len;
+
+	net_rx_pb = pb;
+	ret = net_handle_ip_payload(pb->data, len);
+	net_rx_pb = rx_pb;
+
+	pktbuf_put(pb);
+
+	return ret;
+}
+
+/*
+ * Add a fragment to its datagram and pass the datagram on once it is
+ * complete.
+ */
+static int ip_frag_reassemble(unsigned char *pkt)
+{
+	struct iphdr *ip = (struct iphdr *)(pkt + ETHER_HDR_SIZE);
+	unsigned int hlen = (ip->hl_v & 0x0f) * 4;
+	unsigned int frag_off = ntohs(ip->frag_off);
+	unsigned int offset = (frag_off & IP_OFFSET) * 8;
+	unsigned int size = ntohs(ip->tot_len) - hlen;
+	unsigned int i;
+	struct ip_frag *f;
+	unsigned char *buf;
+
+	/* all but the last fragment carry a multiple of 8 bytes */
+	if (offset + size > IP_MAX_PAYLOAD ||
+	    ((frag_off & IP_FLAG_MF) && (!size || size & 7)))
+		return 0;
+
+	f = ip_frag_find(ip);
+	if (!f)
+		return 0;
+
+	buf = f->pb->data;
+
+	if (!(frag_off & IP_FLAG_MF)) {
+		if (f->total && f->total != offset + size)
+			goto drop;
+		f->total = offset + size;
+	}
+
+	if (f->total && offset + size > f->total)
+		goto drop;
+
+	if (!offset)
+		memcpy(buf, pkt, ETHER_HDR_SIZE + sizeof(struct iphdr));
+
+	memcpy(buf + ETHER_HDR_SIZE + sizeof(struct iphdr) + offset,
+	       (void *)ip + hlen, size);
+
+	for (i = offset / 8; i < DIV_ROUND_UP(offset + size, 8); i++)
+		if (!test_and_set_bit(i, f->map))
+			f->units++;
+
+	if (!f->total || f->units < DIV_ROUND_UP(f->total, 8))
+		return 0;
+
+	f->used = 0;
+
+	ip = (struct iphdr *)(buf + ETHER_HDR_SIZE);
+	ip->hl_v = 0x45;
+	ip->tot_len = htons(sizeof(struct iphdr) + f->total);
+	ip->frag_off = 0;
+	ip->check = 0;
+	ip->check = ~net_checksum((unsigned char *)ip, sizeof(struct iphdr));
+
+	return ip_frag_deliver(f, ETHER_HDR_SIZE + sizeof(struct iphdr) +
+			       f->total);
+drop:
+	f->used = 0;
+	return 0;
+}
+
 static int net_handle_ip(struct eth_device *edev, unsigned char *pkt, int len)
 {
 	struct iphdr *ip = (struct iphdr *)(pkt + ETHER_HDR_SIZE);
@@ -586,8 +802,9 @@ static int net_handle_ip(struct eth_device *edev, unsigned char *pkt, int len)
 	if ((ip->hl_v & 0xf0) != 0x40)
 		goto bad;
 
-	if (ip->frag_off & htons(0x1fff)) /* Can't deal w/ fragments */
+	if ((ip->hl_v & 0x0f) < 5 || ntohs(ip->tot_len) < (ip->hl_v & 0x0f) * 4)
 		goto bad;
+
 	if (!net_checksum_ok((unsigned char *)ip, sizeof(struct iphdr)))
 		goto bad;
 
@@ -595,14 +812,14 @@ static int net_handle_ip(struct eth_device *edev, unsigned char *pkt, int len)
 	if (edev->ipaddr && tmp != edev->ipaddr && tmp != IP_BROADCAST)
 		return 0;
 
-	switch (ip->protocol) {
-	case IPPROTO_ICMP:
-		return net_handle_icmp(pkt, len);
-	case IPPROTO_UDP:
-		return net_handle_udp(pkt, len);
+	if (ip->frag_off & htons(IP_FLAG_MF | IP_OFFSET)) {
+		if (!IS_ENABLED(CONFIG_NET_IP_REASSEMBLY))
+			goto bad;
+
+		return ip_frag_reassemble(pkt);
 	}
 
-	return 0;
+	return net_handle_ip_payload(pkt, len);
 bad:
 	net_bad_packet(pkt, len);
 	return 0;
@@ -622,7 +839,7 @@ int net_receive(struct eth_device *edev, unsigned char *pkt, int len)
 	}
 
 	if (IS_ENABLED(CONFIG_NET_PICOTCP))
-		return pico_stack_recv(edev->picodev, pkt, len);
+		return pico_adapter_recv(edev, pkt, len);
 
 	switch (et_protlen) {
 	case PROT_ARP:
@@ -640,6 +857,48 @@ out:
 	return ret;
 }
 
+struct pktbuf *net_rx_hold(void)
+{
+	struct pktbuf *pb = net_rx_pb;
+
+	if (!pb)
+		return NULL;
+
+	/* the driver can only let go of its buffer if it gets another one */
+	if (pb == net_rx_driver_pb && !net_rx_spare) {
+		net_rx_spare = pktbuf_alloc();
+		if (!net_rx_spare)
+			return NULL;
+	}
+
+	return pktbuf_get(pb);
+}
+
+struct pktbuf *net_receive_pktbuf(struct eth_device *edev, struct pktbuf *pb,
+		int len)
+{
+	struct pktbuf *spare;
+
+	pb->len = len;
+	net_rx_pb = net_rx_driver_pb = pb;
+
+	net_receive(edev, pb->data, len);
+
+	net_rx_pb = net_rx_driver_pb = NULL;
+	spare = net_rx_spare;
+	net_rx_spare = NULL;
+
+	if (pb->refcount == 1) {
+		if (spare)
+			pktbuf_put(spare);
+		return pb;
+	}
+
+	pktbuf_put(pb);
+
+	return spare;
+}
+
 static int net_init(void)
 {
 	int i;
@@ -37,15 +37,53 @@ static int pico_adapter_send(struct pico_device *dev, void *buf, int len)
 	return ret ? ret : len;
 }
 
+static void pico_adapter_free(uint8_t *buf)
+{
+	pktbuf_put(pktbuf_from_data(buf));
+}
+
+/*
+ * Queue a received frame. When the driver received into a packet buffer
+ * the frame is built around it, otherwise pico_stack_recv() copies it.
+ */
+int pico_adapter_recv(struct eth_device *edev, void *pkt, int len)
+{
+	struct pico_device *dev = edev->picodev;
+	struct pktbuf *pb;
+	int refcount, ret;
+
+	pb = net_rx_hold();
+	if (!pb)
+		return pico_stack_recv(dev, pkt, len);
+
+	/*
+	 * The receive path still holds its own reference, so pb stays valid
+	 * here. On failure the stack has dropped our reference through
+	 * pico_adapter_free() only when it got as far as queueing the frame.
+	 */
+	refcount = pb->refcount;
+
+	ret = pico_stack_recv_zerocopy_ext_buffer_notify(dev, pb->data, len,
+							 pico_adapter_free);
+	if (ret <= 0 && pb->refcount == refcount)
+		pktbuf_put(pb);
+
+	return ret;
+}
+
 static int pico_adapter_poll(struct pico_device *dev, int loop_score)
 {
 	struct pico_device_barebox_eth *t = (struct pico_device_barebox_eth *)dev;
 	struct eth_device *edev = t->edev;
+	int ret;
 
-	if (edev->active)
-		edev->recv(edev);
+	if (!edev->active)
+		return loop_score;
 
 	/* pico_stack_recv(dev, buf, len) will be called from net_receive */
+	ret = eth_poll(edev, loop_score);
+	if (ret > 0)
+		loop_score -= ret;
 
 	return loop_score;
 }
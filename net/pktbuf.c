@@ -0,0 +1,115 @@
+/*
+ * pktbuf.c - reference counted network packet buffers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <common.h>
+#include <net.h>
+#include <dma.h>
+#include <linux/list.h>
+
+/*
+ * The buffer header, the headroom and the data each start on their own
+ * cache line, so that the data area can be handed to DMA while the CPU
+ * updates the header.
+ */
+#define PKTBUF_HDR_SIZE		ALIGN(sizeof(struct pktbuf), DMA_ALIGNMENT)
+
+static LIST_HEAD(pktbuf_pool);
+static unsigned int pktbuf_pool_count;
+
+static struct pktbuf *__pktbuf_alloc(unsigned int size)
+{
+	struct pktbuf *pb;
+
+	size = ALIGN(size, DMA_ALIGNMENT);
+
+	pb = dma_alloc(PKTBUF_HDR_SIZE + PKTBUF_HEADROOM + size);
+	if (!pb)
+		return NULL;
+
+	pb->data = (void *)pb + PKTBUF_HDR_SIZE + PKTBUF_HEADROOM;
+	pb->size = size;
+	pb->pooled = 0;
+
+	return pb;
+}
+
+/**
+ * pktbuf_alloc - get a PKTBUF_SIZE buffer from the pool
+ *
+ * Return NULL when PKTBUF_POOL_MAX buffers are in use.
+ */
+struct pktbuf *pktbuf_alloc(void)
+{
+	struct pktbuf *pb;
+
+	if (!list_empty(&pktbuf_pool)) {
+		pb = list_first_entry(&pktbuf_pool, struct pktbuf, list);
+		list_del(&pb->list);
+	} else {
+		if (pktbuf_pool_count >= PKTBUF_POOL_MAX)
+			return NULL;
+
+		pb = __pktbuf_alloc(PKTBUF_SIZE);
+		if (!pb)
+			return NULL;
+
+		pb->pooled = 1;
+		pktbuf_pool_count++;
+	}
+
+	pb->len = 0;
+	pb->refcount = 1;
+
+	return pb;
+}
+
+/**
+ * pktbuf_alloc_size - allocate a buffer for at least @size bytes
+ *
+ * Buffers larger than PKTBUF_SIZE do not come from the pool but are
+ * allocated and freed as needed.
+ */
+struct pktbuf *pktbuf_alloc_size(unsigned int size)
+{
+	struct pktbuf *pb;
+
+	if (size <= PKTBUF_SIZE)
+		return pktbuf_alloc();
+
+	pb = __pktbuf_alloc(size);
+	if (!pb)
+		return NULL;
+
+	pb->len = 0;
+	pb->refcount = 1;
+
+	return pb;
+}
+
+void pktbuf_put(struct pktbuf *pb)
+{
+	if (--pb->refcount)
+		return;
+
+	if (pb->pooled)
+		list_add(&pb->list, &pktbuf_pool);
+	else
+		dma_free(pb);
+}
+
+/* Find the buffer from its data pointer, e.g. when a stack hands it back */
+struct pktbuf *pktbuf_from_data(void *data)
+{
+	return data - PKTBUF_HEADROOM - PKTBUF_HDR_SIZE;
+}